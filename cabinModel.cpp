@@ -0,0 +1,131 @@
+/** @file cabinModel.cpp
+ *  @brief Batched cabin thermal model.
+ *
+ *  Euler step of C dT/dt = UA (Tout - T) + Q for every coach.
+ *  cabinStepScalar() is the reference, cabinStep() uses AVX2
+ *  when the compiler targets it (8 coaches per instruction).
+ *
+ */
+
+
+
+#include "cabinModel.h"
+#include "JAHdebug.h"
+
+#include <vector>
+
+float cabinMaskHeat[CABIN_MASKS];
+
+
+/// @brief Heat input of one output bitmask
+/// @param mask bit (1 << hardwareItems) set for each item running
+/// @return BTU/h, negative when cooling
+float cabinHeatForMask(unsigned int mask) {
+    float heat = 0;
+    //compressors cool, or heat when reversing valve is on
+    int comps = ((mask >> HI_Comp1) & 1) + ((mask >> HI_Comp2) & 1);
+    if (mask & (1u << HI_reversingValve)) {
+        heat += comps * CAP_HEATPUMP;
+    } else {
+        heat -= comps * CAP_COMP;
+    }
+    if (mask & (1u << HI_gasHeat)) heat += CAP_GAS;
+    if (mask & (1u << HI_CoachHeatLow)) heat += CAP_COACH_LOW;
+    if (mask & (1u << HI_CoachHeatHigh)) heat += CAP_COACH_HIGH;
+    if (mask & (1u << HI_FanLow)) heat += CAP_FAN_LOW;
+    if (mask & (1u << HI_FanHigh)) heat += CAP_FAN_HIGH;
+    return heat;
+}
+
+/// @brief Fill cabinMaskHeat, call once before cabinHeatFromMask()
+void cabinInit() {
+    for (unsigned int m = 0; m < CABIN_MASKS; m++) {
+        cabinMaskHeat[m] = cabinHeatForMask(m);
+    }
+    return;
+}
+
+/// @brief Converts output bitmasks to heat input by table lookup
+/// @param mask array of hvacLogic::getOutputMask() values
+/// @param heat array receiving BTU/h
+/// @param count number of coaches
+void cabinHeatFromMask(const unsigned int *mask, float *heat, int count) {
+    int i = 0;
+    #ifdef __AVX2__
+    const __m256i limit = _mm256_set1_epi32(CABIN_MASKS - 1);
+    for (; i + 8 <= count; i += 8) {
+        __m256i m = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(mask + i)), limit);
+        _mm256_storeu_ps(heat + i, _mm256_i32gather_ps(cabinMaskHeat, m, 4));
+    }
+    #endif
+    for (; i < count; i++) {
+        heat[i] = cabinMaskHeat[mask[i] & (CABIN_MASKS - 1)];
+    }
+    return;
+}
+
+/// @brief Reference step, one coach at a time
+/// @param batch fleet state, temp is updated
+/// @param hours time step in hours
+void cabinStepScalar(cabinBatch &batch, float hours) {
+    for (int i = 0; i < batch.count; i++) {
+        float flow = batch.ua[i] * (batch.outdoor[i] - batch.temp[i]);
+        float gain = flow + batch.heat[i];
+        float rate = gain / batch.mass[i];
+        batch.temp[i] = batch.temp[i] + rate * hours;
+    }
+    return;
+}
+
+/// @brief Fast step, same math as cabinStepScalar() 8 coaches at a time
+/// @param batch fleet state, temp is updated
+/// @param hours time step in hours
+void cabinStep(cabinBatch &batch, float hours) {
+    int i = 0;
+    #ifdef __AVX2__
+    //separate mul and add (no fma) to match the scalar rounding
+    const __m256 dt = _mm256_set1_ps(hours);
+    for (; i + 8 <= batch.count; i += 8) {
+        __m256 t = _mm256_loadu_ps(batch.temp + i);
+        __m256 flow = _mm256_mul_ps(_mm256_loadu_ps(batch.ua + i),
+                                    _mm256_sub_ps(_mm256_loadu_ps(batch.outdoor + i), t));
+        __m256 gain = _mm256_add_ps(flow, _mm256_loadu_ps(batch.heat + i));
+        __m256 rate = _mm256_div_ps(gain, _mm256_loadu_ps(batch.mass + i));
+        _mm256_storeu_ps(batch.temp + i, _mm256_add_ps(t, _mm256_mul_ps(rate, dt)));
+    }
+    #endif
+    //tail, or everything without AVX2
+    for (; i < batch.count; i++) {
+        float flow = batch.ua[i] * (batch.outdoor[i] - batch.temp[i]);
+        float gain = flow + batch.heat[i];
+        float rate = gain / batch.mass[i];
+        batch.temp[i] = batch.temp[i] + rate * hours;
+    }
+    return;
+}
+
+/// @brief Runs both steps on copies of temp and compares, batch is not changed
+/// @param batch fleet state
+/// @param hours time step in hours
+/// @return largest difference in *F between cabinStep() and cabinStepScalar()
+float cabinCheck(const cabinBatch &batch, float hours) {
+    std::vector<float> ref(batch.temp, batch.temp + batch.count);
+    std::vector<float> fast(batch.temp, batch.temp + batch.count);
+    cabinBatch a = batch;
+    cabinBatch b = batch;
+    a.temp = ref.data();
+    b.temp = fast.data();
+    cabinStepScalar(a, hours);
+    cabinStep(b, hours);
+    float worst = 0;
+    for (int i = 0; i < batch.count; i++) {
+        float diff = ref[i] - fast[i];
+        if (diff < 0) diff = -diff;
+        if (diff > worst) worst = diff;
+    }
+    if (worst > CABIN_TOLERANCE) {
+        debugI("cabinCheck scalar vs vector error *F: ");
+        debuglnI(worst);
+    }
+    return worst;
+}
@@ -0,0 +1,65 @@
+/** @file cabinModel.h
+ *  @brief Batched cabin thermal model for simulating many coaches.
+ *
+ *  Cabin temperatures of a whole fleet are stored as arrays
+ *  (one array per quantity, one entry per coach) and advanced
+ *  together in one call. Heat input of each coach comes from
+ *  the output bitmask of its hvacLogic.
+ *
+ */
+
+
+#ifndef CABINMODEL_H
+#define CABINMODEL_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+//equipment capacities in BTU/h, positive heats cabin
+
+//Compressor cooling capacity each (13500)
+#define CAP_COMP 13500
+//Compressor heating capacity each in heat pump mode (12000)
+#define CAP_HEATPUMP 12000
+//Gas furnace output (32000), 40k BTU input
+#define CAP_GAS 32000
+//Coach heat low (8000)
+#define CAP_COACH_LOW 8000
+//Coach heat high (16000)
+#define CAP_COACH_HIGH 16000
+//Fan low motor heat (300)
+#define CAP_FAN_LOW 300
+//Fan high motor heat (600)
+#define CAP_FAN_HIGH 600
+
+//number of possible output bitmasks
+#define CABIN_MASKS (1 << HI_SizeOf)
+//allowed scalar vs vector difference in *F per step
+#define CABIN_TOLERANCE 0.001f
+
+/// @brief Heat input in BTU/h for each output bitmask, filled by cabinInit()
+extern float cabinMaskHeat[CABIN_MASKS];
+
+/// @brief Fleet thermal state, each pointer is an array of count entries
+struct cabinBatch {
+    int count; //number of coaches
+    float *temp; //cabin temperature *F
+    float *outdoor; //outdoor temperature *F
+    float *ua; //envelope conductance BTU/h per *F
+    float *mass; //thermal mass BTU per *F
+    float *heat; //heat input BTU/h, see cabinHeatFromMask()
+};
+
+void cabinInit();
+float cabinHeatForMask(unsigned int mask);
+void cabinHeatFromMask(const unsigned int *mask, float *heat, int count);
+void cabinStepScalar(cabinBatch &batch, float hours);
+void cabinStep(cabinBatch &batch, float hours);
+float cabinCheck(const cabinBatch &batch, float hours);
+
+#endif
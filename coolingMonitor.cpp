@@ -0,0 +1,138 @@
+/** @file coolingMonitor.cpp
+ *  @brief Detects falling cooling capacity (refrigerant leak, weak compressor).
+ *
+ */
+
+
+
+#include "coolingMonitor.h"
+#include "JAHdebug.h"
+
+/// @brief Integer square root, no floating point needed on the MCU
+static long coolingSqrt(long long v) {
+    if (v <= 0) return 0;
+    long long r = v;
+    long long x = (r + 1) / 2;
+    while (x < r) {
+        r = x;
+        x = (x + v / x) / 2;
+    }
+    return (long)r;
+}
+
+coolingMonitor::coolingMonitor() :
+    c_comps(0),
+    c_bin(0),
+    c_runStart(0),
+    c_startTemp(-128),
+    c_startTime(0),
+    c_lastTemp(-128),
+    c_lastRate(0),
+    c_alert(false)
+{
+    for (int c = 0; c < 2; c++) {
+        for (int b = 0; b < CM_BINS; b++) {
+            c_base[c][b].mean = 0;
+            c_base[c][b].variance = 0;
+            c_base[c][b].samples = 0;
+            c_base[c][b].low = 0;
+        }
+    }
+}
+
+/// @brief Clears the alert and low run counts, ie: after service
+void coolingMonitor::clearAlert() {
+    c_alert = false;
+    for (int c = 0; c < 2; c++) {
+        for (int b = 0; b < CM_BINS; b++) c_base[c][b].low = 0;
+    }
+    return;
+}
+
+/// @brief Feeds one controller snapshot, call each logic tick
+/// @param status from hvacLogic::getStatus()
+/// @param outdoor outdoor temperature *F or CM_NO_OUTDOOR
+void coolingMonitor::update(const hvacStatus &status, int outdoor) {
+    unsigned long now = timeNow();
+    int comps = 0;
+    if (!(status.outputs & (1u << HI_reversingValve))) {
+        comps = ((status.outputs >> HI_Comp1) & 1) + ((status.outputs >> HI_Comp2) & 1);
+    }
+    if (comps != c_comps) {
+        c_finish(now);
+        c_comps = comps;
+        c_runStart = now;
+        c_startTemp = -128;
+    }
+    if (c_comps == 0 || status.temp == -128) return;
+    c_lastTemp = status.temp;
+    //at the setpoint the unit only holds temp, the rate says nothing about capacity
+    if (status.temp <= status.coolSetpoint) {
+        c_finish(now);
+        c_startTemp = -128;
+        return;
+    }
+
+    if (c_startTemp == -128) {
+        if (now - c_runStart < CM_SETTLE) return;
+        c_startTemp = status.temp;
+        c_startTime = now;
+        c_bin = 0;
+        if (outdoor != CM_NO_OUTDOOR && outdoor > status.temp) {
+            c_bin = (outdoor - status.temp) / CM_BIN_WIDTH;
+            if (c_bin >= CM_BINS) c_bin = CM_BINS - 1;
+        }
+        return;
+    }
+    //long steady runs give a sample every few CM_MIN_RUN
+    if (now - c_startTime >= 4UL * CM_MIN_RUN) {
+        c_finish(now);
+        c_startTemp = status.temp;
+        c_startTime = now;
+    }
+    return;
+}
+
+/// @brief Ends a measured run, judges it against the baseline and learns it
+void coolingMonitor::c_finish(unsigned long now) {
+    if (c_comps == 0 || c_startTemp == -128) return;
+    unsigned long elapsed = now - c_startTime;
+    if (elapsed < CM_MIN_RUN) return;
+    coolingBaseline &base = c_base[c_comps - 1][c_bin];
+    int drop = c_startTemp - c_lastTemp;
+    //a small change is rounding, unless the baseline expected well more in this time
+    if (drop < CM_MIN_DROP && drop > -CM_MIN_DROP) {
+        if (base.samples < CM_MIN_SAMPLES) return;
+        if ((long long)base.mean * c_comps * elapsed / (100LL * 3600000) < 2 * CM_MIN_DROP) return;
+    }
+    long rate = (long)(((long long)drop * 100 * 3600000) / (long long)elapsed / c_comps);
+    c_lastRate = rate;
+
+    if (base.samples >= CM_MIN_SAMPLES) {
+        long sd = coolingSqrt(base.variance);
+        bool low = (rate < base.mean - CM_SIGMA * sd) && ((long long)rate * 100 < (long long)base.mean * CM_DROP_PCT);
+        if (low) {
+            //do not learn low runs, the baseline must not follow a leak down
+            if (base.low < 255) base.low++;
+            if (base.low >= CM_ALERT_COUNT && !c_alert) {
+                c_alert = true;
+                debugI("- Cooling monitor low cooling rate: ");
+                debugI(rate);
+                debugI(" baseline: ");
+                debuglnI(base.mean);
+            }
+            return;
+        }
+        base.low = 0;
+    }
+    if (base.samples == 0) {
+        base.mean = rate;
+        base.variance = 0;
+    } else {
+        long diff = rate - base.mean;
+        base.mean += diff / (1 << CM_LEARN);
+        base.variance += ((long long)diff * diff - base.variance) / (1 << CM_LEARN);
+    }
+    if (base.samples < 65535) base.samples++;
+    return;
+}
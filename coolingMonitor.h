@@ -0,0 +1,81 @@
+/** @file coolingMonitor.h
+ *  @brief Detects falling cooling capacity (refrigerant leak, weak compressor).
+ *
+ *  Measures how fast the cabin cools per running compressor and
+ *  compares it with a rolling baseline kept for similar conditions
+ *  (number of compressors, outdoor to cabin difference), only while
+ *  the cabin is above the cool setpoint. Baselines
+ *  are exponential mean and variance in integers, so memory and
+ *  cost per update are constant and it runs on the MCU or host.
+ *
+ */
+
+
+#ifndef COOLINGMONITOR_H
+#define COOLINGMONITOR_H
+
+#pragma once
+
+#include "hvac.h"
+
+//cooling monitor parameters, times in milliseconds, rates in 1/100 *F per hour
+
+//ignore cooling right after compressor start (180000)
+#define CM_SETTLE 180000
+//shortest measured cooling run (600000)
+#define CM_MIN_RUN 600000
+//baseline samples needed before judging (8)
+#define CM_MIN_SAMPLES 8
+//baseline smoothing, new sample weighs 1/(2^CM_LEARN) (5)
+#define CM_LEARN 5
+//low when rate is below mean - CM_SIGMA standard deviations (3)
+#define CM_SIGMA 3
+//and below this percent of mean (70)
+#define CM_DROP_PCT 70
+//*F a measured run must cool, less is mostly rounding of whole *F readings (2)
+#define CM_MIN_DROP 2
+//consecutive low runs before alert (3)
+#define CM_ALERT_COUNT 3
+//outdoor minus cabin *F per condition bin (10)
+#define CM_BIN_WIDTH 10
+//condition bins, last one open ended (4)
+#define CM_BINS 4
+//outdoor temp value when unknown
+#define CM_NO_OUTDOOR -128
+
+/// @brief Rolling baseline of one condition
+struct coolingBaseline {
+    long mean; //1/100 *F per hour per compressor
+    long long variance; //of the same units squared
+    unsigned int samples;
+    unsigned char low; //consecutive low runs
+};
+
+/// @brief Streaming cooling effectiveness check, feed it every logic tick
+class coolingMonitor
+{
+public:
+    coolingMonitor();
+    void update(const hvacStatus &status, int outdoor = CM_NO_OUTDOOR);
+    /// @brief true once CM_ALERT_COUNT low runs in a row were seen in one condition
+    bool isAlert() {return c_alert;};
+    void clearAlert();
+    /// @brief Last measured cooling rate
+    /// @return 1/100 *F per hour per compressor, 0 if none yet
+    long getLastRate() {return c_lastRate;};
+    const coolingBaseline &getBaseline(int comps, int bin) {return c_base[comps - 1][bin];};
+
+private:
+    void c_finish(unsigned long now);
+    coolingBaseline c_base[2][CM_BINS]; //by compressors running, condition bin
+    int c_comps; //compressors running in current run, 0 if none
+    int c_bin; //condition bin of current run
+    unsigned long c_runStart; //compressor count last changed
+    int c_startTemp; //temperature once settled, -128 until then
+    unsigned long c_startTime; //time of c_startTemp
+    int c_lastTemp;
+    long c_lastRate;
+    bool c_alert;
+};
+
+#endif
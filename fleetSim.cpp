@@ -0,0 +1,644 @@
+/** @file fleetSim.cpp
+ *  @brief Fleet simulation, many coaches each running hvacLogic.
+ *
+ */
+
+
+
+#include "fleetSim.h"
+#include "JAHdebug.h"
+
+#if defined(WIN32) && defined(HVAC_SIM)
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+
+/// @brief One simulated coach, owns its hardware so coaches share nothing
+struct fleetCoach {
+    Hvac gasHeater;
+    Hvac fanLow;
+    Hvac fanHigh;
+    Hvac coachHeatLow;
+    Hvac coachHeatHigh;
+    Compressor compressor1;
+    Compressor compressor2;
+    ReversingValve reversingValve;
+    HvacItem items[HI_SizeOf]; //in hardwareItems order, hvacLogic indexes it
+    HvacItem *itemPtr[HI_SizeOf];
+    bool avail[HI_SizeOf];
+    bool notDisabled[HI_SizeOf];
+    hvacLogic tstat;
+    std::vector<availEvent> events;
+    size_t nextEvent;
+
+    fleetCoach() :
+        gasHeater(0, HI_gasHeat),
+        fanLow(0, HI_FanLow),
+        fanHigh(0, HI_FanHigh),
+        coachHeatLow(0, HI_CoachHeatLow),
+        coachHeatHigh(0, HI_CoachHeatHigh),
+        compressor1(0, HI_Comp1),
+        compressor2(0, HI_Comp2),
+        reversingValve(0, HI_reversingValve),
+        items{HvacItem(&gasHeater), HvacItem(&fanLow), HvacItem(&fanHigh),
+              HvacItem(&coachHeatLow), HvacItem(&coachHeatHigh),
+              HvacItem(&compressor1), HvacItem(&compressor2), HvacItem(&reversingValve)},
+        itemPtr{&items[0], &items[1], &items[2], &items[3],
+                &items[4], &items[5], &items[6], &items[7]},
+        tstat(itemPtr, avail, notDisabled),
+        nextEvent(0)
+    {
+        for (int i = 0; i < HI_SizeOf; i++) {
+            avail[i] = true;
+            notDisabled[i] = true;
+        }
+    };
+};
+
+/// @brief StateMachine keeps one static state map per class, built from the
+/// state members of the first object that takes an event. Build it from a
+/// coach that lives until exit so chunks can create and free their coaches.
+static void fleetAnchorStateMaps() {
+    static fleetCoach *anchor = NULL;
+    if (anchor != NULL) return;
+    setTimeNow(0);
+    anchor = new fleetCoach();
+    anchor->compressor1.Start();
+    anchor->compressor1.Stop();
+    anchor->reversingValve.Start();
+    anchor->reversingValve.Stop();
+    return;
+}
+
+/// @brief Simulates coaches first..first+count-1 for the whole run.
+/// Only depends on config and coach numbers, not on the calling thread.
+static void fleetChunk(const fleetConfig &config, unsigned long first, unsigned long count, fleetCoachMetrics *metrics) {
+    setTimeNow(0);
+    std::unique_ptr<fleetCoach[]> coaches(new fleetCoach[count]);
+    std::vector<float> temp(count), outdoor(count), ua(count), mass(count), heat(count);
+    std::vector<unsigned int> mask(count, 0);
+    //heat by output mask of each fitted coach, the others use cabinMaskHeat
+    std::vector<float> fitHeat;
+    std::vector<bool> fitted(count, false);
+    bool fits = (config.fits != NULL && !config.fits->empty());
+    if (fits) fitHeat.resize((size_t)count * CABIN_MASKS);
+    scenarioGenerator gen(config.seed);
+    float start = config.weather ? config.weather->at(0).temp : config.outdoor;
+
+    for (unsigned long i = 0; i < count; i++) {
+        unsigned long coach = first + i;
+        fleetCoach &fc = coaches[i];
+        //coach to coach spread of cabin, from the coach's own stream
+        scenarioRng rng(config.seed, (unsigned long long)coach * FLEET_STREAMS + STREAM_CABIN);
+        ua[i] = 250.0f + rng.range(0, 150);
+        mass[i] = 3000.0f + rng.range(0, 3000);
+        if (fits) {
+            const cabinFit &f = (*config.fits)[coach % config.fits->size()];
+            if (f.ok) {
+                ua[i] = f.ua;
+                mass[i] = f.mass;
+                fitMaskHeat(f, &fitHeat[(size_t)i * CABIN_MASKS]);
+                fitted[i] = true;
+            }
+        }
+        temp[i] = start;
+        int trip = (config.trip < 0) ? (int)(coach % tripTemplateCount) : config.trip;
+        gen.generate(coach, tripTemplates[trip], config.days, fc.events);
+        fc.tstat.setCoolSetpoint(config.coolSetpoint);
+        fc.tstat.setHeatSetpoint(config.heatSetpoint);
+        fc.tstat.setCoolSetpoint(config.coolSetpoint);
+        fc.tstat.setMode(config.mode);
+        memset(&metrics[i], 0, sizeof(fleetCoachMetrics));
+    }
+
+    cabinBatch batch;
+    batch.count = (int)count;
+    batch.temp = temp.data();
+    batch.outdoor = outdoor.data();
+    batch.ua = ua.data();
+    batch.mass = mass.data();
+    batch.heat = heat.data();
+    unsigned long steps = config.days * 86400UL / config.stepSeconds;
+    float hours = config.stepSeconds / 3600.0f;
+    bool watchHeat = (config.mode == M_Heat || config.mode == M_Auto);
+    bool watchCool = (config.mode == M_Cool || config.mode == M_Auto);
+
+    for (unsigned long s = 0; s < steps; s++) {
+        unsigned long sec = s * config.stepSeconds;
+        setTimeNow(sec * 1000UL);
+        float out = config.weather ? config.weather->at(sec).temp : config.outdoor;
+        for (unsigned long i = 0; i < count; i++) {
+            fleetCoach &fc = coaches[i];
+            fleetCoachMetrics &m = metrics[i];
+            outdoor[i] = out;
+            scenarioApply(fc.tstat, fc.events, fc.nextEvent, sec);
+            fc.tstat.setTemp((int)(temp[i] < 0 ? temp[i] - 0.5f : temp[i] + 0.5f));
+            fc.tstat.Poll();
+            unsigned int on = fc.tstat.getOutputMask();
+            unsigned int started = on & ~mask[i];
+            for (int b = 0; b < HI_SizeOf; b++) {
+                if (on & (1u << b)) m.runSeconds[b] += config.stepSeconds;
+                if (started & (1u << b)) m.starts[b]++;
+            }
+            mask[i] = on;
+            if (watchHeat && temp[i] < config.heatSetpoint) m.degreeHours += (config.heatSetpoint - temp[i]) * hours;
+            if (watchCool && temp[i] > config.coolSetpoint) m.degreeHours += (temp[i] - config.coolSetpoint) * hours;
+        }
+        cabinHeatFromMask(mask.data(), heat.data(), (int)count);
+        if (fits) {
+            for (unsigned long i = 0; i < count; i++) {
+                if (fitted[i]) heat[i] = fitHeat[(size_t)i * CABIN_MASKS + (mask[i] & (CABIN_MASKS - 1))];
+            }
+        }
+        cabinStep(batch, hours);
+    }
+    return;
+}
+
+/// @brief Bytes rounded up to whole FLEET_PAGE pages
+static size_t fleetPages(size_t bytes) {
+    return (bytes + FLEET_PAGE - 1) / FLEET_PAGE * FLEET_PAGE;
+}
+
+/// @brief Bytes of metrics for a run, each chunk padded to whole pages
+static size_t fleetMetricsBytes(unsigned long coaches) {
+    unsigned long chunks = (coaches + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    return chunks * fleetPages(FLEET_CHUNK * sizeof(fleetCoachMetrics));
+}
+
+/// @brief Metrics of one coach, chunks are a page aligned stride apart so each
+/// chunk's pages are first written, and placed, by the node that runs it
+/// @param metrics page aligned, fleetMetricsBytes() long
+static fleetCoachMetrics *fleetMetricsAt(fleetCoachMetrics *metrics, unsigned long coach) {
+    char *chunk = (char *)metrics + (coach / FLEET_CHUNK) * fleetPages(FLEET_CHUNK * sizeof(fleetCoachMetrics));
+    return (fleetCoachMetrics *)chunk + coach % FLEET_CHUNK;
+}
+
+/// @brief Fills config with a small default run
+void fleetDefaults(fleetConfig &config) {
+    config.coaches = 1000;
+    config.days = 7;
+    config.stepSeconds = 60;
+    config.seed = 1;
+    config.threads = 0;
+    config.nodes = 0;
+    config.trip = -1;
+    config.mode = M_Auto;
+    config.heatSetpoint = 68;
+    config.coolSetpoint = 76;
+    config.outdoor = 90.0f;
+    config.weather = NULL;
+    config.fits = NULL;
+    return;
+}
+
+/// @brief Checks a config before any work starts
+static bool fleetValid(const fleetConfig &config) {
+    if (config.coaches == 0 || config.days == 0 || config.days > FLEET_MAX_DAYS || config.stepSeconds == 0) return false;
+    if (config.trip >= tripTemplateCount) return false;
+    return true;
+}
+
+/// @brief Processors of the NUMA nodes a run uses, fallback is one node without pinning
+/// @param maxNodes nodes to use, 0 for all
+/// @param nodes receives the processor mask of each node that has processors
+static void fleetTopology(int maxNodes, std::vector<GROUP_AFFINITY> &nodes) {
+    nodes.clear();
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest)) highest = 0;
+    for (ULONG n = 0; n <= highest; n++) {
+        if (maxNodes > 0 && (int)nodes.size() >= maxNodes) break;
+        GROUP_AFFINITY affinity;
+        memset(&affinity, 0, sizeof(affinity));
+        if (!GetNumaNodeProcessorMaskEx((USHORT)n, &affinity) || affinity.Mask == 0) continue; //memory only node
+        nodes.push_back(affinity);
+    }
+    if (nodes.empty()) {
+        GROUP_AFFINITY none;
+        memset(&none, 0, sizeof(none));
+        nodes.push_back(none);
+    }
+    return;
+}
+
+/// @brief Processors in a mask
+static int fleetCores(const GROUP_AFFINITY &node) {
+    int cores = 0;
+    for (KAFFINITY m = node.Mask; m != 0; m &= m - 1) cores++;
+    return cores;
+}
+
+/// @brief Pins the calling thread to one processor of a node
+/// @param index which processor of the node, wraps when there are more threads than processors
+static void fleetPin(const GROUP_AFFINITY &node, int index) {
+    int cores = fleetCores(node);
+    if (cores == 0) return;
+    index = index % cores;
+    KAFFINITY m = node.Mask;
+    for (int i = 0; i < index; i++) m &= m - 1;
+    GROUP_AFFINITY one = node;
+    one.Mask = m & (~m + 1); //lowest remaining processor
+    SetThreadGroupAffinity(GetCurrentThread(), &one, NULL);
+    return;
+}
+
+/// @brief NUMA nodes with processors on this machine
+int fleetNodes() {
+    std::vector<GROUP_AFFINITY> nodes;
+    fleetTopology(0, nodes);
+    return (int)nodes.size();
+}
+
+/// @brief Runs chunks firstChunk..lastChunk-1 on threads pinned round robin to
+/// the cores of config.nodes NUMA nodes. Each node has its own range of chunks,
+/// a thread takes from another node only once its own node has none left.
+/// Coaches are allocated inside fleetChunk() by the pinned thread, and metrics
+/// pages are first written there too, so both land on the thread's node. A chunk's
+/// metrics have pages of their own (fleetMetricsAt()), a neighbour never shares one.
+/// @param metrics page aligned, fleetMetricsBytes() long
+/// @param firstThread pinning offset, worker processes pass shard * threads so they use different cores
+static void fleetWork(const fleetConfig &config, unsigned long firstChunk, unsigned long lastChunk,
+                      int threads, int firstThread, fleetCoachMetrics *metrics) {
+    cabinInit();
+    fleetAnchorStateMaps();
+    std::vector<GROUP_AFFINITY> nodes;
+    fleetTopology(config.nodes, nodes);
+    int nodeCount = (int)nodes.size();
+    unsigned long chunks = lastChunk - firstChunk;
+    if (threads <= 0) {
+        threads = 0;
+        for (int n = 0; n < nodeCount; n++) threads += fleetCores(nodes[n]);
+    }
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    if ((unsigned long)threads > chunks) threads = (int)chunks;
+    if (nodeCount > threads) nodeCount = threads;
+
+    //chunk range of each node in proportion to its threads (thread t runs on node t % nodeCount)
+    std::unique_ptr<std::atomic<unsigned long>[]> next(new std::atomic<unsigned long>[nodeCount]);
+    std::vector<unsigned long> end(nodeCount);
+    int before = 0;
+    for (int n = 0; n < nodeCount; n++) {
+        int on = threads / nodeCount + (n < threads % nodeCount ? 1 : 0);
+        next[n] = firstChunk + (unsigned long)((unsigned long long)chunks * before / threads);
+        before += on;
+        end[n] = firstChunk + (unsigned long)((unsigned long long)chunks * before / threads);
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            int home = t % nodeCount;
+            fleetPin(nodes[home], (firstThread + t) / nodeCount);
+            for (int k = 0; k < nodeCount; k++) {
+                int n = (home + k) % nodeCount; //own node first, then steal
+                for (unsigned long c = next[n]++; c < end[n]; c = next[n]++) {
+                    unsigned long first = c * FLEET_CHUNK;
+                    unsigned long count = config.coaches - first;
+                    if (count > FLEET_CHUNK) count = FLEET_CHUNK;
+                    fleetChunk(config, first, count, fleetMetricsAt(metrics, first));
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    return;
+}
+
+/// @brief Sums metrics in coach order so floating point rounding is the same every run
+static void fleetReduce(const fleetConfig &config, fleetCoachMetrics *metrics, fleetReport &report) {
+    report.coaches = config.coaches;
+    report.coachSteps = (unsigned long long)config.coaches * (config.days * 86400UL / config.stepSeconds);
+    for (unsigned long i = 0; i < config.coaches; i++) {
+        const fleetCoachMetrics &m = *fleetMetricsAt(metrics, i);
+        for (int b = 0; b < HI_SizeOf; b++) {
+            report.runSeconds[b] += m.runSeconds[b];
+            report.starts[b] += m.starts[b];
+        }
+        report.degreeHours += m.degreeHours;
+    }
+    return;
+}
+
+/// @brief Simulates the fleet on several threads
+/// @param config what to simulate
+/// @param report receives the results
+/// @return false if config is invalid
+bool fleetRun(const fleetConfig &config, fleetReport &report) {
+    memset(&report, 0, sizeof(report));
+    if (!fleetValid(config)) return false;
+
+    //committed but untouched, pages are placed when a worker first writes them
+    size_t size = fleetMetricsBytes(config.coaches);
+    fleetCoachMetrics *metrics = (fleetCoachMetrics *)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (metrics == NULL) return false;
+    unsigned long chunks = (config.coaches + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    fleetWork(config, 0, chunks, config.threads, 0, metrics);
+    fleetReduce(config, metrics, report);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+    VirtualFree(metrics, 0, MEM_RELEASE);
+    return true;
+}
+
+/// @brief Runs config on 1, 2 .. all NUMA nodes using every core of them and
+/// prints throughput of each. Checksums must match, only the speed may differ.
+/// @return false if a run failed or a checksum differed
+bool fleetScaling(const fleetConfig &config) {
+    fleetConfig c = config;
+    c.threads = 0;
+    int nodes = fleetNodes();
+    double base = 0;
+    unsigned long long sum = 0;
+    bool ok = true;
+    for (int n = 1; n <= nodes; n++) {
+        c.nodes = n;
+        fleetReport report;
+        if (!fleetRun(c, report)) return false;
+        double rate = report.seconds > 0 ? report.coachSteps / report.seconds : 0;
+        if (n == 1) {
+            base = rate;
+            sum = fleetChecksum(report);
+        }
+        if (fleetChecksum(report) != sum) ok = false;
+        debugI("Fleet nodes: ");
+        debugI(n);
+        debugI(" coach steps per second: ");
+        debugI(rate);
+        debugI(" speedup: ");
+        debuglnI(base > 0 ? rate / base : 0);
+    }
+    if (!ok) debuglnI("Fleet scaling checksum differs between node counts!");
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////
+// Worker processes...
+
+/// @brief Start of the shared memory region, padded to whole pages and followed by
+/// the metrics (fleetMetricsBytes()) then cabinFit[fitCount]
+struct fleetShared {
+    unsigned long magic; //FLEET_MAGIC once filled in
+    unsigned long coaches;
+    unsigned long days;
+    unsigned long stepSeconds;
+    unsigned long long seed;
+    int threads; //per process
+    int nodes;
+    int trip;
+    int mode;
+    int heatSetpoint;
+    int coolSetpoint;
+    float outdoor;
+    char weatherPath[FLEET_PATH]; //empty for config.outdoor
+    unsigned long fitCount;
+    long processes;
+    volatile LONG arrived; //workers at the start barrier
+    volatile LONG shardDone[FLEET_MAX_PROCESSES]; //1 once a shard wrote all its metrics
+};
+
+/// @brief Chunks of one shard, contiguous so a shard is the same coaches every run
+static void fleetShard(unsigned long coaches, long processes, long shard, unsigned long &firstChunk, unsigned long &lastChunk) {
+    unsigned long chunks = (coaches + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    firstChunk = (unsigned long)((unsigned long long)chunks * shard / processes);
+    lastChunk = (unsigned long)((unsigned long long)chunks * (shard + 1) / processes);
+    return;
+}
+
+/// @brief Starts one worker process on a shard
+static HANDLE fleetSpawn(const char *exe, const std::string &name, long shard) {
+    std::string cmd = std::string("\"") + exe + "\" " + FLEET_WORKER_ARG + " " + name + " " + std::to_string(shard);
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    memset(&pi, 0, sizeof(pi));
+    std::vector<char> line(cmd.begin(), cmd.end());
+    line.push_back(0);
+    if (!CreateProcessA(exe, line.data(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
+        debugI("Fleet can not start worker ");
+        debuglnI(shard);
+        return NULL;
+    }
+    CloseHandle(pi.hThread);
+    return pi.hProcess;
+}
+
+/// @brief ms a shard may take from the start barrier, FLEET_JOIN_MIN plus FLEET_STEP_US per coach step and thread
+static DWORD fleetShardTimeout(const fleetShared *shared, long shard) {
+    unsigned long firstChunk, lastChunk;
+    fleetShard(shared->coaches, shared->processes, shard, firstChunk, lastChunk);
+    unsigned long long last = (unsigned long long)lastChunk * FLEET_CHUNK;
+    if (last > shared->coaches) last = shared->coaches;
+    unsigned long long steps = (last - (unsigned long long)firstChunk * FLEET_CHUNK) * (shared->days * 86400ULL / shared->stepSeconds);
+    unsigned long long ms = FLEET_JOIN_MIN + steps * FLEET_STEP_US / 1000 / (shared->threads > 0 ? shared->threads : 1);
+    return (ms < INFINITE) ? (DWORD)ms : INFINITE - 1;
+}
+
+/// @brief true if a worker process ended and left its shard complete,
+/// a worker still running after timeoutMs is hung and is terminated
+static bool fleetJoin(HANDLE process, const fleetShared *shared, long shard, DWORD timeoutMs) {
+    if (process == NULL) return false;
+    if (WaitForSingleObject(process, timeoutMs) != WAIT_OBJECT_0) {
+        debugI("Fleet worker timed out, shard ");
+        debuglnI(shard);
+        TerminateProcess(process, 1);
+        WaitForSingleObject(process, INFINITE);
+    }
+    DWORD code = 1;
+    GetExitCodeProcess(process, &code);
+    CloseHandle(process);
+    return code == 0 && shared->shardDone[shard] == 1;
+}
+
+/// @brief Simulates the fleet in worker processes of this executable, each
+/// owning a shard of chunks. A crashed or hung worker is restarted once, a
+/// shard is hung when it runs past fleetShardTimeout() from the start. Call
+/// fleetWorkerMain() at the top of main() so workers find their shard.
+/// @param config what to simulate, threads is per process (0 to split the cores)
+/// @param processes worker processes, at most FLEET_MAX_PROCESSES
+/// @param report receives the results, same checksum as fleetRun()
+/// @return false if config is invalid or a shard failed twice
+bool fleetRunProcesses(const fleetConfig &config, int processes, fleetReport &report) {
+    memset(&report, 0, sizeof(report));
+    if (!fleetValid(config)) return false;
+    if (config.weather != NULL && config.weather->getPath().size() >= FLEET_PATH) return false;
+    unsigned long chunks = (config.coaches + FLEET_CHUNK - 1) / FLEET_CHUNK;
+    if (processes <= 0) processes = 1;
+    if (processes > FLEET_MAX_PROCESSES) processes = FLEET_MAX_PROCESSES;
+    if ((unsigned long)processes > chunks) processes = (int)chunks;
+    unsigned long fitCount = (config.fits != NULL) ? (unsigned long)config.fits->size() : 0;
+
+    //one region, paged from the system file, named by this process
+    unsigned long long size = fleetPages(sizeof(fleetShared)) + fleetMetricsBytes(config.coaches)
+                              + (unsigned long long)fitCount * sizeof(cabinFit);
+    std::string name = "Local\\hvacFleet" + std::to_string(GetCurrentProcessId());
+    HANDLE map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                    (DWORD)(size >> 32), (DWORD)size, name.c_str());
+    if (map == NULL) return false;
+    fleetShared *shared = (fleetShared *)MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (shared == NULL) {
+        CloseHandle(map);
+        return false;
+    }
+    HANDLE go = CreateEventA(NULL, TRUE, FALSE, (name + "Go").c_str());
+    fleetCoachMetrics *metrics = (fleetCoachMetrics *)((char *)shared + fleetPages(sizeof(fleetShared)));
+    cabinFit *fits = (cabinFit *)((char *)metrics + fleetMetricsBytes(config.coaches));
+
+    memset(shared, 0, sizeof(fleetShared));
+    shared->coaches = config.coaches;
+    shared->days = config.days;
+    shared->stepSeconds = config.stepSeconds;
+    shared->seed = config.seed;
+    shared->threads = config.threads;
+    if (shared->threads <= 0) shared->threads = (int)std::thread::hardware_concurrency() / processes;
+    if (shared->threads <= 0) shared->threads = 1;
+    shared->nodes = config.nodes;
+    shared->trip = config.trip;
+    shared->mode = config.mode;
+    shared->heatSetpoint = config.heatSetpoint;
+    shared->coolSetpoint = config.coolSetpoint;
+    shared->outdoor = config.outdoor;
+    if (config.weather != NULL) strcpy(shared->weatherPath, config.weather->getPath().c_str());
+    shared->fitCount = fitCount;
+    for (unsigned long f = 0; f < fitCount; f++) fits[f] = (*config.fits)[f];
+    shared->processes = processes;
+    MemoryBarrier();
+    shared->magic = FLEET_MAGIC;
+
+    char exe[MAX_PATH];
+    GetModuleFileNameA(NULL, exe, MAX_PATH);
+    std::vector<HANDLE> workers(processes, (HANDLE)NULL);
+    for (int p = 0; p < processes; p++) workers[p] = fleetSpawn(exe, name, p);
+
+    //start barrier, timing starts when every worker is loaded and ready
+    DWORD waited = 0;
+    while (shared->arrived < processes && waited < FLEET_BARRIER_TIMEOUT) {
+        bool alive = true;
+        for (int p = 0; p < processes; p++) {
+            if (workers[p] == NULL || WaitForSingleObject(workers[p], 0) == WAIT_OBJECT_0) alive = false;
+        }
+        if (!alive) break; //a worker died early, its restart below skips the barrier
+        Sleep(1);
+        waited++;
+    }
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    SetEvent(go);
+
+    bool ok = true;
+    for (int p = 0; p < processes; p++) {
+        //workers run side by side, each timeout counts from the start
+        DWORD timeout = fleetShardTimeout(shared, p);
+        long long spent = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - began).count();
+        if (fleetJoin(workers[p], shared, p, (spent < (long long)timeout) ? (DWORD)(timeout - spent) : 0)) continue;
+        debugI("Fleet worker failed, restarting shard ");
+        debuglnI(p);
+        if (!fleetJoin(fleetSpawn(exe, name, p), shared, p, timeout)) ok = false;
+    }
+    if (ok) fleetReduce(config, metrics, report);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+
+    if (go != NULL) CloseHandle(go);
+    UnmapViewOfFile(shared);
+    CloseHandle(map);
+    return ok;
+}
+
+/// @brief Runs a shard when this process was started by fleetRunProcesses()
+/// @return false if not started as a worker, otherwise true once the shard is done (then exit)
+bool fleetWorkerMain(int argc, char *argv[]) {
+    if (argc < 4 || strcmp(argv[1], FLEET_WORKER_ARG) != 0) return false;
+    long shard = atol(argv[3]);
+    HANDLE map = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, argv[2]);
+    if (map == NULL) exit(2);
+    fleetShared *shared = (fleetShared *)MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (shared == NULL || shared->magic != FLEET_MAGIC || shard < 0 || shard >= shared->processes) exit(2);
+    fleetCoachMetrics *metrics = (fleetCoachMetrics *)((char *)shared + fleetPages(sizeof(fleetShared)));
+    const cabinFit *fits = (const cabinFit *)((char *)metrics + fleetMetricsBytes(shared->coaches));
+
+    fleetConfig config;
+    fleetDefaults(config);
+    config.coaches = shared->coaches;
+    config.days = shared->days;
+    config.stepSeconds = shared->stepSeconds;
+    config.seed = shared->seed;
+    config.threads = shared->threads;
+    config.nodes = shared->nodes;
+    config.trip = shared->trip;
+    config.mode = (hvacMode)shared->mode;
+    config.heatSetpoint = shared->heatSetpoint;
+    config.coolSetpoint = shared->coolSetpoint;
+    config.outdoor = shared->outdoor;
+    weatherData weather;
+    if (shared->weatherPath[0] != 0) {
+        if (!weather.open(shared->weatherPath)) exit(3);
+        config.weather = &weather;
+    }
+    std::vector<cabinFit> fitCopy(fits, fits + shared->fitCount);
+    if (!fitCopy.empty()) config.fits = &fitCopy;
+
+    unsigned long firstChunk, lastChunk;
+    fleetShard(config.coaches, shared->processes, shard, firstChunk, lastChunk);
+    InterlockedIncrement(&shared->arrived);
+    HANDLE go = OpenEventA(SYNCHRONIZE, FALSE, (std::string(argv[2]) + "Go").c_str());
+    if (go != NULL) {
+        WaitForSingleObject(go, FLEET_BARRIER_TIMEOUT);
+        CloseHandle(go);
+    }
+    fleetWork(config, firstChunk, lastChunk, config.threads, (int)shard * config.threads, metrics);
+    MemoryBarrier();
+    InterlockedExchange(&shared->shardDone[shard], 1);
+    UnmapViewOfFile(shared);
+    CloseHandle(map);
+    return true;
+}
+
+/// @brief Adds the bytes of one value to an FNV-1a hash
+static void fleetHash(unsigned long long &h, const void *value, size_t length) {
+    const unsigned char *p = (const unsigned char *)value;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    return;
+}
+
+/// @brief FNV-1a hash of the simulated results, equal reports give equal checksums.
+/// Members are hashed one by one so struct padding never counts, wall time is left out.
+unsigned long long fleetChecksum(const fleetReport &report) {
+    unsigned long long h = 0xCBF29CE484222325ULL;
+    unsigned long long coaches = report.coaches;
+    fleetHash(h, &coaches, sizeof(coaches));
+    fleetHash(h, &report.coachSteps, sizeof(report.coachSteps));
+    fleetHash(h, report.runSeconds, sizeof(report.runSeconds));
+    fleetHash(h, report.starts, sizeof(report.starts));
+    fleetHash(h, &report.degreeHours, sizeof(report.degreeHours));
+    return h;
+}
+
+/// @brief Prints a report
+void fleetPrint(const fleetReport &report) {
+    debugI("Fleet coaches: ");
+    debugI(report.coaches);
+    debugI(" coach steps: ");
+    debuglnI(report.coachSteps);
+    for (int b = 0; b < HI_SizeOf; b++) {
+        debugI(hvacHardwareItemsNames[b]);
+        debugI(" run hours: ");
+        debugI(report.runSeconds[b] / 3600);
+        debugI(" starts: ");
+        debuglnI(report.starts[b]);
+    }
+    debugI("Degree hours outside setpoints: ");
+    debuglnI(report.degreeHours);
+    debugI("Wall seconds: ");
+    debugI(report.seconds);
+    debugI(" coach steps per second: ");
+    debuglnI(report.seconds > 0 ? report.coachSteps / report.seconds : 0);
+    debugI("Checksum: ");
+    debuglnI(fleetChecksum(report));
+    return;
+}
+#endif
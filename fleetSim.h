@@ -0,0 +1,95 @@
+/** @file fleetSim.h
+ *  @brief Fleet simulation, many coaches each running hvacLogic.
+ *
+ *  Build with HVAC_SIM defined so timeNow() is the simulated clock.
+ *  Coaches are split into fixed chunks of FLEET_CHUNK. A chunk is
+ *  always simulated the same way no matter which thread takes it,
+ *  random numbers come from counter based streams per coach and
+ *  per coach metrics are summed in coach order. Reports are bit
+ *  identical for any thread count. fleetRunProcesses() spreads the
+ *  chunks over worker processes sharing one memory region instead,
+ *  so a crashing coach takes down only its shard.
+ *
+ */
+
+
+#ifndef FLEETSIM_H
+#define FLEETSIM_H
+
+#pragma once
+
+#include "hvac.h"
+#include "cabinModel.h"
+#include "scenario.h"
+#include "weather.h"
+#include "thermalFit.h"
+
+#if defined(WIN32) && defined(HVAC_SIM)
+#include <vector>
+
+//coaches per chunk of work, multiple of 8 so AVX2 lanes never depend on threads
+#define FLEET_CHUNK 64
+//metrics of each chunk start on a page of this size, so no page is written by two nodes (4096)
+#define FLEET_PAGE 4096
+//longest run, timeNow() is 32 bit milliseconds
+#define FLEET_MAX_DAYS 45
+//worker processes at most
+#define FLEET_MAX_PROCESSES 64
+//longest weather file path handed to worker processes
+#define FLEET_PATH 260
+//ms to wait for all workers at the start barrier (30000)
+#define FLEET_BARRIER_TIMEOUT 30000
+//ms a worker shard gets on top of its simulation time before it is killed and restarted (30000)
+#define FLEET_JOIN_MIN 30000
+//us allowed per coach step of a shard and thread, measured cost is about 0.2 (50)
+#define FLEET_STEP_US 50
+//command line argument marking a worker process
+#define FLEET_WORKER_ARG "--fleet-worker"
+//shared region magic "FLT1"
+#define FLEET_MAGIC 0x31544C46
+
+/// @brief What to simulate
+struct fleetConfig {
+    unsigned long coaches;
+    unsigned long days; //at most FLEET_MAX_DAYS
+    unsigned long stepSeconds; //simulation step
+    unsigned long long seed;
+    int threads; //0 for every core of the nodes used
+    int nodes; //NUMA nodes to use, 0 for all
+    int trip; //index into tripTemplates, -1 to rotate by coach
+    hvacMode mode;
+    int heatSetpoint; //*F
+    int coolSetpoint; //*F
+    float outdoor; //*F, used when weather is NULL
+    const weatherData *weather; //shared outdoor conditions or NULL
+    const std::vector<cabinFit> *fits; //fitted cabins (UA, mass and capacities) used by coach number, or NULL for spread of defaults
+};
+
+/// @brief Results of one coach
+struct fleetCoachMetrics {
+    unsigned long runSeconds[HI_SizeOf]; //time each item was on
+    unsigned long starts[HI_SizeOf]; //off to on changes of each item
+    double degreeHours; //*F hours outside setpoints
+};
+
+/// @brief Results of the fleet, summed over coaches in coach order
+struct fleetReport {
+    unsigned long coaches;
+    unsigned long long coachSteps;
+    unsigned long long runSeconds[HI_SizeOf];
+    unsigned long long starts[HI_SizeOf];
+    double degreeHours;
+    double seconds; //wall time of the run, not part of the checksum
+};
+
+void fleetDefaults(fleetConfig &config);
+bool fleetRun(const fleetConfig &config, fleetReport &report);
+bool fleetRunProcesses(const fleetConfig &config, int processes, fleetReport &report);
+bool fleetWorkerMain(int argc, char *argv[]);
+int fleetNodes();
+bool fleetScaling(const fleetConfig &config);
+unsigned long long fleetChecksum(const fleetReport &report);
+void fleetPrint(const fleetReport &report);
+#endif
+
+#endif
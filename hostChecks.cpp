@@ -0,0 +1,165 @@
+/** @file hostChecks.cpp
+ *  @brief Runs the host only checks in one go and asserts on their results.
+ *
+ */
+
+
+
+#include "hostChecks.h"
+#include "JAHdebug.h"
+
+#if defined(WIN32) && defined(HVAC_SIM)
+#include "hvacBench.h"
+#include "cabinModel.h"
+#include "fleetSim.h"
+#include "journal.h"
+#include "telemetryLink.h"
+#include "telemetryPack.h"
+#include <cstdio>
+#include <cmath>
+
+/// @brief One controller with its own hardware, as fleetSim builds a coach
+struct hostCoach {
+    Hvac gasHeater;
+    Hvac fanLow;
+    Hvac fanHigh;
+    Hvac coachHeatLow;
+    Hvac coachHeatHigh;
+    Compressor compressor1;
+    Compressor compressor2;
+    ReversingValve reversingValve;
+    HvacItem items[HI_SizeOf]; //in hardwareItems order, hvacLogic indexes it
+    HvacItem *itemPtr[HI_SizeOf];
+    bool avail[HI_SizeOf];
+    bool notDisabled[HI_SizeOf];
+    hvacLogic tstat;
+
+    hostCoach() :
+        gasHeater(0, HI_gasHeat),
+        fanLow(0, HI_FanLow),
+        fanHigh(0, HI_FanHigh),
+        coachHeatLow(0, HI_CoachHeatLow),
+        coachHeatHigh(0, HI_CoachHeatHigh),
+        compressor1(0, HI_Comp1),
+        compressor2(0, HI_Comp2),
+        reversingValve(0, HI_reversingValve),
+        items{HvacItem(&gasHeater), HvacItem(&fanLow), HvacItem(&fanHigh),
+              HvacItem(&coachHeatLow), HvacItem(&coachHeatHigh),
+              HvacItem(&compressor1), HvacItem(&compressor2), HvacItem(&reversingValve)},
+        itemPtr{&items[0], &items[1], &items[2], &items[3],
+                &items[4], &items[5], &items[6], &items[7]},
+        tstat(itemPtr, avail, notDisabled)
+    {
+        for (int i = 0; i < HI_SizeOf; i++) {
+            avail[i] = true;
+            notDisabled[i] = true;
+        }
+    };
+};
+
+/// @brief A coach that lives until exit, StateMachine keeps the state maps of the
+/// first object that takes an event and fleetSim builds its coaches after these
+static hostCoach *hostCoachNew() {
+    setTimeNow(0);
+    return new hostCoach();
+}
+
+/// @brief Prints the outcome of one check
+/// @return 1 if it failed, to add to the failures
+static int hostResult(const char *name, bool pass) {
+    char line[96];
+    snprintf(line, sizeof(line), "check %s %s", name, pass ? "pass" : "FAIL");
+    benchPrint(line);
+    return pass ? 0 : 1;
+}
+
+/// @brief Drops packed blocks, only the packer's counts are wanted
+static void hostDropBlock(const unsigned char *block, unsigned int length, void *context) {
+    return;
+}
+
+/// @brief One coach cooling through a day, outdoor 75 to 95 *F, Poll once a second,
+/// every status recorded in the journal and given to a packer
+/// @return false if the journal can not be written or does not pack back the same
+static bool hostJournalDay(const std::string &journalPath) {
+    std::remove(journalPath.c_str());
+    hvacJournal journal;
+    if (!journal.open(journalPath)) return false;
+    telemetryPacker packer(hostDropBlock, NULL);
+    hostCoach *coach = hostCoachNew();
+    hvacLogic &tstat = coach->tstat;
+    tstat.setHeatSetpoint(68);
+    tstat.setCoolSetpoint(74);
+    tstat.setMode(M_Auto);
+    cabinInit();
+    float temp = 78.0f, outdoor = 85.0f, ua = 300.0f, mass = 4500.0f, heat = 0.0f;
+    cabinBatch batch;
+    batch.count = 1;
+    batch.temp = &temp;
+    batch.outdoor = &outdoor;
+    batch.ua = &ua;
+    batch.mass = &mass;
+    batch.heat = &heat;
+    hvacStatus status;
+    for (unsigned long t = 0; t < HC_DAY; t += 1000) {
+        setTimeNow(t);
+        outdoor = 85.0f - 10.0f * (float)cos(6.2831853 * t / HC_DAY);
+        tstat.setTemp((int)(temp + 0.5f));
+        tstat.Poll();
+        tstat.getStatus(status);
+        journal.record(status, 1660089600000LL + t);
+        packer.add(status, t);
+        heat = cabinHeatForMask(tstat.getOutputMask());
+        cabinStep(batch, 1.0f / 3600.0f);
+    }
+    packer.flush();
+    journal.close();
+    char line[192];
+    unsigned long ratio = packer.getRatio();
+    unsigned long changes = (packer.getBytes() == 0) ? 0 :
+        (unsigned long)((unsigned long long)packer.getChanges() * TL_STATUS_SIZE * 100 / packer.getBytes());
+    snprintf(line, sizeof(line), "pack day snapshots %lu changes %lu bytes %lu ratio %lu.%02lu changes ratio %lu.%02lu journal records %lu",
+             packer.getSnapshots(), packer.getChanges(), packer.getBytes(), ratio / 100, ratio % 100,
+             changes / 100, changes % 100, journal.getRecords());
+    benchPrint(line);
+    std::string report;
+    bool same = telemetryPackJournal(journalPath, report);
+    report = "pack journal " + report;
+    benchPrint(report.c_str());
+    return same && journal.getDropped() == 0;
+}
+
+/// @brief Runs every host check, see hostChecks.h
+/// @param journalPath file for the journal day, replaced
+/// @return number of checks that failed
+int hostChecks(const std::string &journalPath) {
+    int failed = 0;
+    std::string report;
+    bool pass = telemetryLoopback(HC_LOOPBACK_RECORDS, report);
+    benchPrint(report.c_str());
+    failed += hostResult("telemetryLoopback", pass);
+
+    failed += hostResult("telemetryPackJournal", hostJournalDay(journalPath));
+
+    hostCoach *fixed = hostCoachNew();
+    hostCoach *adaptive = hostCoachNew();
+    failed += hostResult("benchLogicRate", benchLogicRate(fixed->tstat, adaptive->tstat, HC_DAY) <= 0);
+
+    fleetConfig config;
+    fleetDefaults(config);
+    config.coaches = HC_FLEET_COACHES;
+    config.days = HC_FLEET_DAYS;
+    failed += hostResult("fleetScaling", fleetScaling(config));
+
+    char line[64];
+    snprintf(line, sizeof(line), "checks failed %d", failed);
+    benchPrint(line);
+    return failed;
+}
+
+#ifdef HVAC_HOST_CHECKS
+int main(int argc, char *argv[]) {
+    return (hostChecks((argc > 1) ? argv[1] : "hostChecks.jrn") == 0) ? 0 : 1;
+}
+#endif
+#endif
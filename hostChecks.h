@@ -0,0 +1,45 @@
+/** @file hostChecks.h
+ *  @brief Runs the host only checks in one go and asserts on their results.
+ *
+ *  hostChecks() runs, on the simulated clock:
+ *  - telemetryLoopback(): link and decoder over a pipe, every record
+ *    must arrive intact and in order.
+ *  - a simulated cooling day of one coach (cabinModel, one Poll a
+ *    second) recorded with hvacJournal and fed to a telemetryPacker,
+ *    then telemetryPackJournal() on the journal: every record must
+ *    unpack the same.
+ *  - benchLogicRate() over a day: the adaptive rate must not evaluate
+ *    more often than the fixed one.
+ *  - fleetScaling() on a small fleet: checksums must match on every
+ *    node count.
+ *  Each check prints its report and a pass or FAIL line through
+ *  benchPrint(), whatever the debug switch.
+ *  Build with WIN32 and HVAC_SIM defined, with HVAC_HOST_CHECKS also
+ *  defined hostChecks.cpp has a main() that runs them and exits 1 on
+ *  a failure.
+ *
+ */
+
+
+#ifndef HOSTCHECKS_H
+#define HOSTCHECKS_H
+
+#pragma once
+
+#include "hvac.h"
+
+#if defined(WIN32) && defined(HVAC_SIM)
+#include <string>
+
+//records telemetryLoopback() sends (100000)
+#define HC_LOOPBACK_RECORDS 100000
+//simulated ms of the journal day and of benchLogicRate() (86400000)
+#define HC_DAY 86400000UL
+//coaches and days of the fleetScaling() run (256, 1)
+#define HC_FLEET_COACHES 256
+#define HC_FLEET_DAYS 1
+
+int hostChecks(const std::string &journalPath);
+#endif
+
+#endif
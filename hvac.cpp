@@ -15,6 +15,8 @@
 
 
 #include "hvac.h"
+#include "hvacBench.h"
+#include "tempEstimator.h"
 #include "JAHdebug.h"
 
 #ifdef WIN32
@@ -27,26 +29,63 @@
 
 
 
+#ifdef HVAC_SIM
+//simulated clock, one per thread so each simulator thread runs its own coaches
+static thread_local unsigned long hvacSimNow = 0;
+
+/// @brief Sets simulated tick time returned by timeNow() on this thread
+/// @param ms simulated milliseconds from start
+void setTimeNow(unsigned long ms) {
+    hvacSimNow = ms;
+}
+#endif
+
 /// @brief Gets current tick time depending on environment
 /// @return current milliseconds from start or epoch
 unsigned long timeNow() {
+    #ifdef HVAC_SIM
+        return hvacSimNow;
+    #else
     #ifdef WIN32
         return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
     #endif
     #ifdef PLATFORMIO
         return millis();
     #endif
+    #endif
 };
 
+//compile time checks of goal logic and delay table, a bad edit fails the build
+
+static_assert(hvacGoalFor(M_Cool, 80, 70, 73) == HM_HighCool, "cool at 80 must run both compressors");
+static_assert(hvacGoalFor(M_Cool, 74, 70, 73) == HM_LowCool, "cool 1 over setpoint must run one compressor");
+static_assert(hvacGoalFor(M_Cool, 73, 70, 73) == HM_Off, "cool at setpoint must be off");
+static_assert(hvacGoalFor(M_Heat, 69, 70, 73) == HM_LowHeat, "heat 1 under setpoint must be low heat");
+static_assert(hvacGoalFor(M_Heat, 66, 70, 73) == HM_HighHeat, "heat 4 under setpoint must be high heat");
+static_assert(hvacGoalFor(M_Heat, 65, 70, 73) == HM_MaxHeat, "heat 5 under setpoint must be max heat");
+static_assert(hvacGoalFor(M_Auto, 71, 70, 73) == HM_Off, "auto between setpoints must be off");
+static_assert(hvacGoalFor(M_Auto, 80, 70, 73) == HM_HighCool && hvacGoalFor(M_Auto, 60, 70, 73) == HM_MaxHeat, "auto must cool and heat");
+static_assert(hvacGoalFor(M_Off, 90, 70, 73) == HM_Off, "off must stay off");
+static_assert(hvacGoalMargin(M_Cool, 73, 70, 73) == 1 && hvacGoalMargin(M_Cool, 70, 70, 73) == 4, "margin is the *F to the next cool stage");
+static_assert(LOGIC_RATE_MIN >= LOGIC_RATE, "the adaptive rate must not evaluate more often than the fixed rate");
+static_assert(hvacLogicInterval(1, 0, LOGIC_RATE_MIN, LOGIC_RATE_MAX) == LOGIC_RATE_MIN, "next to a threshold evaluates fastest");
+static_assert(hvacLogicInterval(LOGIC_MARGIN, 0, LOGIC_RATE_MIN, LOGIC_RATE_MAX) <= LOGIC_RATE_MAX, "interval must stay under LOGIC_RATE_MAX");
+static_assert(hvacLogicInterval(LOGIC_MARGIN, 0, LOGIC_RATE_MIN, LOGIC_RATE_MAX) == LOGIC_RATE_MAX, "LOGIC_RATE_MAX must be reachable within LOGIC_MARGIN");
+static_assert(hvacLogicInterval(LOGIC_MARGIN, LOGIC_MARGIN, LOGIC_RATE_MIN, LOGIC_RATE_MAX) == LOGIC_RATE_MIN, "moving temp evaluates fastest");
+static_assert((hvacStageDelay(2) == HVAC_STAGE_NONE) == !HVAC_HAS_COMP2, "stage 2 delay only with comp2 fitted");
+static_assert(hvacStageDelay(2) == HVAC_STAGE_NONE || hvacStageDelay(2) > hvacStageDelay(1), "comp2 must start after comp1 (C_T_C)");
+static_assert(hvacStageDelay(1) > 0, "compressor must start after fan (F_T_C)");
+static_assert(MT_HARD_START > C_R_D, "hard start window shorter than restart delay never counts");
+
 #ifdef WIN32
-const std::string hvacHardwareItemsNames[HI_SizeOf] = {"Compressor 1",
-                             "Compressor 2",
-                             "Gas Heater",
-                             "Reversing Valve",
+const std::string hvacHardwareItemsNames[HI_SizeOf] = {"Gas Heater",
                              "Fan Low",
                              "Fan High",
                              "Coach Heat Low",
-                             "Coach Heat High"
+                             "Coach Heat High",
+                             "Compressor 1",
+                             "Compressor 2",
+                             "Reversing Valve"
 };
 
 const std::string hvacModeNames[M_SizeOf] = {"Off", "Cool", "Heat", "Auto"};
@@ -82,6 +121,7 @@ Hvac::Hvac(byte OutputPinNumber, hardwareItems me) :
     h_isPoll(false),
     h_startTime(0),
     h_runTime(0),
+    h_cycles(0),
     h_pin(OutputPinNumber),
     h_me(me)
 {
@@ -108,6 +148,7 @@ void Hvac::Start() {
     #endif
     h_isOn = true;
     h_startTime = timeNow();
+    h_cycles++;
     return;    
 }
 
@@ -167,6 +208,9 @@ Compressor::Compressor(byte OutputPinNumber, hardwareItems me) :
     m_stopTime(timeNow()),
     m_startTime(0),
     m_compressorRunTime(0),
+    m_cycles(0),
+    m_startWear(0),
+    m_hardStarts(0),
     h_me(me),
     m_outputPin(OutputPinNumber)
 {
@@ -186,30 +230,27 @@ Compressor::Compressor(byte OutputPinNumber, hardwareItems me) :
 
 void Compressor::Start()
 {
+    BENCH_SCOPE(BF_CompressorStart);
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(ST_DELAY)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
+        COMPRESSOR_START(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
 
 void Compressor::Stop()
 {
+    BENCH_SCOPE(BF_CompressorStop);
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_STOP)
-        TRANSITION_MAP_ENTRY(ST_STOP)
+        COMPRESSOR_STOP(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
 
 void Compressor::Poll()
 {
+    BENCH_SCOPE(BF_CompressorPoll);
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_RUN)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
+        COMPRESSOR_POLL(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
@@ -269,6 +310,15 @@ STATE_DEFINE(Compressor, Run, NoEventData)
     m_isOn = true;
     m_delayActive = false;
     m_startTime = timeNow();
+    //wear, a start soon after a stop is hard on the compressor
+    unsigned long offTime = m_startTime - m_stopTime;
+    if (m_cycles > 0 && offTime < MT_HARD_START) {
+        m_startWear = m_startWear + MT_START_WEAR + (unsigned long)(((unsigned long long)(MT_HARD_START - offTime) * MT_HARD_WEAR) / MT_HARD_START);
+        m_hardStarts++;
+    } else {
+        m_startWear = m_startWear + MT_START_WEAR;
+    }
+    m_cycles++;
     #ifdef PLATFORMIO
         digitalWrite(m_outputPin, HARDWAREON);
     #endif
@@ -300,6 +350,7 @@ ReversingValve::ReversingValve(byte OutputPinNumber, hardwareItems me) :
     m_stopTime(timeNow()),
     m_startTime(0),
     m_compressorRunTime(0),
+    m_cycles(0),
     h_me(me),
     m_outputPin(OutputPinNumber)
 {
@@ -321,10 +372,7 @@ ReversingValve::ReversingValve(byte OutputPinNumber, hardwareItems me) :
 void ReversingValve::Start()
 {
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(ST_DELAYON)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_DELAYON)
+        REVERSINGVALVE_START(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
@@ -332,10 +380,7 @@ void ReversingValve::Start()
 void ReversingValve::Stop()
 {
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_DELAYOFF)
-        TRANSITION_MAP_ENTRY(ST_DELAYOFF)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
+        REVERSINGVALVE_STOP(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
@@ -343,10 +388,7 @@ void ReversingValve::Stop()
 void ReversingValve::Poll()
 {
     BEGIN_TRANSITION_MAP
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_RUN)
-        TRANSITION_MAP_ENTRY(EVENT_IGNORED)
-        TRANSITION_MAP_ENTRY(ST_STOP)
+        REVERSINGVALVE_POLL(TRANSITION_MAP_ENTRY)
     END_TRANSITION_MAP(NULL)
     return;
 }
@@ -431,6 +473,7 @@ STATE_DEFINE(ReversingValve, Run, NoEventData)
     m_isOn = true;
     m_delayActive = false;
     m_startTime = timeNow();
+    m_cycles++;
     #ifdef PLATFORMIO
         digitalWrite(m_outputPin, HARDWAREON);
     #endif
@@ -459,11 +502,56 @@ hvacLogic::hvacLogic(HvacItem *itemPtr[], bool *avail, bool *disable) {
     h_tempDelayActive = false;
     h_isAvailable = avail;
     h_isNotDisabled = disable;
+    for (int i = 0; i < HI_SizeOf; i++) h_itemRate[i] = 0;
+    h_itemRate[HI_Comp1] = TTC_COMP;
+    h_itemRate[HI_Comp2] = TTC_COMP;
+    h_itemRate[HI_gasHeat] = TTC_GAS;
+    h_itemRate[HI_CoachHeatLow] = TTC_COACH_LOW;
+    h_itemRate[HI_CoachHeatHigh] = TTC_COACH_HIGH;
+    for (int i = 0; i < HM_SizeOf; i++) {
+        h_learnedRate[i] = 0;
+        h_isLearned[i] = false;
+    }
+    h_rateGoal = HM_Off;
+    h_rateTemp = h_temp;
+    h_rateTime = timeNow();
+    h_timeToComfort = 0;
+    h_startHold = false;
+    h_generation = 1;
+    for (int i = 0; i < SF_SizeOf; i++) h_fieldGeneration[i] = h_generation;
+    h_lastOutputs = getOutputMask();
+    for (int i = 0; i < HI_SizeOf; i++) h_lastCounters[i] = h_items[i].getCycles() + h_items[i].getRunTime();
+    h_rateMin = LOGIC_RATE_MIN;
+    h_rateMax = LOGIC_RATE_MAX;
+    h_logicInterval = LOGIC_RATE;
+    h_goalHold = LOGIC_GOAL_HOLD;
+    h_goalTime = timeNow();
+    h_goalFree = true;
+    h_evalTemp = h_temp;
+    h_evaluations = 0;
+    h_logicStart = timeNow();
+    h_estimator = NULL;
     return;
 }
 
+/// @brief Sets the bounds of the goal evaluation interval, equal for a fixed rate
+/// @param rateMin fastest, near a staging threshold or while temp moves, ms
+/// @param rateMax slowest, far inside the deadband and steady, ms
+/// @return false, rateMin 0 or above rateMax or true, succesful
+bool hvacLogic::setLogicRate(unsigned long rateMin, unsigned long rateMax) {
+    if (rateMin == 0 || rateMin > rateMax) return false;
+    h_rateMin = rateMin;
+    h_rateMax = rateMax;
+    return true;
+}
+
 void hvacLogic::setTemp(int temp)  {
+        if (temp != h_temp) {
+            h_changed(SF_Temp);
+            h_wake();
+        }
         h_temp = temp;
+        if (h_estimator != NULL) h_estimator->update(temp, h_modeledRate(getOutputMask()), timeNow());
         debugI("Setting temperature to: ");
         debuglnI(h_temp);
         return;
@@ -474,6 +562,11 @@ void hvacLogic::setTemp(int temp)  {
 /// @return false, cool setpoint less than 2 degrees above heat setpoint or true, succesful
 bool hvacLogic::setCoolSetpoint(int temp) {
     if ((temp - 2) >= h_heatSetpoint) {
+        if (temp != h_coolSetpoint) {
+            h_changed(SF_CoolSetpoint);
+            h_wake();
+            h_goalFree = true;
+        }
         h_coolSetpoint = temp;
         return true;
     } else {
@@ -485,6 +578,11 @@ bool hvacLogic::setCoolSetpoint(int temp) {
 /// @return false, heat setpoint less than 2 degrees below cool setpoint or true, succesful
 bool hvacLogic::setHeatSetpoint(int temp) {
     if ((temp + 2) <= h_coolSetpoint) {
+        if (temp != h_heatSetpoint) {
+            h_changed(SF_HeatSetpoint);
+            h_wake();
+            h_goalFree = true;
+        }
         h_heatSetpoint = temp;
         return true;
     } else {
@@ -496,6 +594,11 @@ bool hvacLogic::setHeatSetpoint(int temp) {
 /// @param mode value from hvacMode
 /// ie: M_Cool
 void hvacLogic::setMode(hvacMode mode) {
+    if (mode != h_currentMode) {
+        h_changed(SF_Mode);
+        h_wake();
+        h_goalFree = true;
+    }
     h_currentMode = mode;
     debugI("Seting mode to: ");
     debuglnI(hvacModeNames[h_currentMode]);
@@ -511,566 +614,540 @@ void hvacLogic::setFanMode(hvacFanMode mode) {
     return;
 }
 
-/// @brief Poll computes all high level logic
-/// call very often in code. Hvac hardware modes are only changed at calc rate.
-void hvacLogic::Poll() {
-    //Machine poll to advance state machines...
+/// @brief Bitmask of hardware outputs that are on
+/// @return bit (1 << hardwareItems) set for each item running ie: HI_Comp1
+unsigned int hvacLogic::getOutputMask() {
+    unsigned int mask = 0;
     for (int i = 0; i < HI_SizeOf; i++) {
-        //debugI(hvacHardwareItemsNames[i]);
-        //debugI(h_items[i].isPoll());
-        //if (h_items[i].isPoll()) h_items[i].Poll();    
-        h_items[i].Poll();
+        if (h_items[i].isOn()) mask |= (1u << i);
     }
-    //fanmode worker...
-    //TODO circ mode emplemented here
-    if (h_fanMode != h_userFanMode) {
-        debugI("---- FanWorker changing fan mode to: ");
-        h_fanMode = h_userFanMode;
-        debuglnI(hvacFanModeNames[h_fanMode]);
+    return mask;
+}
+
+/// @brief Fills a snapshot of the current controller state
+/// @param status receives the snapshot
+void hvacLogic::getStatus(hvacStatus &status) {
+    status.mode = h_currentMode;
+    status.fanMode = h_fanMode;
+    status.goal = h_goalState;
+    status.temp = h_temp;
+    status.heatSetpoint = h_heatSetpoint;
+    status.coolSetpoint = h_coolSetpoint;
+    status.outputs = getOutputMask();
+    status.timeToComfort = h_timeToComfort;
+    status.generation = getGeneration();
+    status.changed = SF_ALL;
+    return;
+}
+
+/// @brief Validates staged settings together and queues them for the next Poll()
+/// @param transaction settings to change, merged onto one still pending
+/// @return false, setpoints less than 2 degrees apart or a value out of range, nothing is queued or true, succesful
+bool hvacLogic::commit(const hvacTransaction &transaction) {
+    hvacTransaction next = h_pending;
+    const unsigned long staged = transaction.t_staged;
+    if (staged & (1ul << SF_Mode)) next.setMode(transaction.t_mode);
+    if (staged & (1ul << SF_FanMode)) next.setFanMode(transaction.t_fanMode);
+    if (staged & (1ul << SF_HeatSetpoint)) next.setHeatSetpoint(transaction.t_heatSetpoint);
+    if (staged & (1ul << SF_CoolSetpoint)) next.setCoolSetpoint(transaction.t_coolSetpoint);
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (transaction.t_notDisableMask & (1u << i)) next.setNotDisable((hardwareItems)i, (transaction.t_notDisable & (1u << i)) != 0);
     }
-    //hardware mode worker...
-    switch(h_goalState) {
-        case HM_Off:
+    //setpoints are checked as they will be, not one against the other's old value
+    int heat = (next.t_staged & (1ul << SF_HeatSetpoint)) ? next.t_heatSetpoint : h_heatSetpoint;
+    int cool = (next.t_staged & (1ul << SF_CoolSetpoint)) ? next.t_coolSetpoint : h_coolSetpoint;
+    if ((cool - 2) < heat ||
+        ((next.t_staged & (1ul << SF_Mode)) && (next.t_mode < M_Off || next.t_mode >= M_SizeOf)) ||
+        ((next.t_staged & (1ul << SF_FanMode)) && (next.t_fanMode < FM_Auto || next.t_fanMode >= FM_SizeOf))) {
+        debuglnI("transaction refused");
+        return false;
+    }
+    h_pending = next;
+    return true;
+}
+
+/// @brief Applies a committed transaction at once, the goal is evaluated again at the next PollGoal()
+void hvacLogic::h_applyPending() {
+    const unsigned long staged = h_pending.t_staged;
+    //a direct setter may have moved the other setpoint since commit(), check the pair again
+    int heat = (staged & (1ul << SF_HeatSetpoint)) ? h_pending.t_heatSetpoint : h_heatSetpoint;
+    int cool = (staged & (1ul << SF_CoolSetpoint)) ? h_pending.t_coolSetpoint : h_coolSetpoint;
+    if ((cool - 2) < heat) {
+        h_pending.clear();
+        debuglnI("transaction refused at apply, setpoints too close");
+        return;
+    }
+    if ((staged & (1ul << SF_Mode)) && h_pending.t_mode != h_currentMode) {
+        h_currentMode = h_pending.t_mode;
+        h_changed(SF_Mode);
+    }
+    //the fan worker in PollItems() takes it over
+    if (staged & (1ul << SF_FanMode)) h_userFanMode = h_pending.t_fanMode;
+    if ((staged & (1ul << SF_HeatSetpoint)) && h_pending.t_heatSetpoint != h_heatSetpoint) {
+        h_heatSetpoint = h_pending.t_heatSetpoint;
+        h_changed(SF_HeatSetpoint);
+    }
+    if ((staged & (1ul << SF_CoolSetpoint)) && h_pending.t_coolSetpoint != h_coolSetpoint) {
+        h_coolSetpoint = h_pending.t_coolSetpoint;
+        h_changed(SF_CoolSetpoint);
+    }
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (h_pending.t_notDisableMask & (1u << i)) setNotDisable((hardwareItems)i, (h_pending.t_notDisable & (1u << i)) != 0);
+    }
+    h_pending.clear();
+    debuglnI("transaction applied");
+    //one goal evaluation for all of it
+    h_nextTime = timeNow();
+    h_goalFree = true;
+    return;
+}
+
+/// @brief Fills a snapshot only if something changed, ie: a subscriber polling for updates
+/// @param status receives the snapshot, generation and changed are always set
+/// @param since generation of the subscriber's last snapshot, 0 for everything
+/// @return statusField bits changed since, 0 and the rest of status untouched if nothing did
+unsigned long hvacLogic::getStatus(hvacStatus &status, unsigned long since) {
+    unsigned long changed = getChanges(since);
+    if (changed != 0) getStatus(status);
+    status.generation = h_generation;
+    status.changed = changed;
+    return changed;
+}
+
+/// @brief Change count, moves on each time a status field changes
+unsigned long hvacLogic::getGeneration() {
+    h_publish();
+    return h_generation;
+}
+
+/// @brief Status fields changed after a generation
+/// @param since generation from getGeneration() or a snapshot, 0 for everything
+/// @return bit (1ul << statusField) set for each field changed
+unsigned long hvacLogic::getChanges(unsigned long since) {
+    h_publish();
+    if (since == h_generation) return 0;
+    unsigned long changed = 0;
+    for (int i = 0; i < SF_SizeOf; i++) {
+        //signed difference so the generation may wrap
+        if ((long)(h_fieldGeneration[i] - since) > 0) changed |= (1ul << i);
+    }
+    return changed;
+}
+
+/// @brief Marks item outputs and counters changed since the last call.
+/// Items change inside their state machines, so they are compared when someone asks
+/// rather than on every Poll.
+void hvacLogic::h_publish() {
+    unsigned int outputs = getOutputMask();
+    unsigned int flipped = outputs ^ h_lastOutputs;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (flipped & (1u << i)) h_changed(SF_Output + i);
+        unsigned long counters = h_items[i].getCycles() + h_items[i].getRunTime();
+        if (counters != h_lastCounters[i]) {
+            h_changed(SF_Counters + i);
+            h_lastCounters[i] = counters;
+        }
+    }
+    h_lastOutputs = outputs;
+    return;
+}
+
+/// @brief Learns the rate of the current goal state from temperature changes
+/// and predicts time to comfort from it, or from modeled item rates until learned.
+/// Constant cost, called each logic tick.
+void hvacLogic::h_updateTimeToComfort() {
+    unsigned long now = timeNow();
+    if (h_goalState != h_rateGoal) {
+        //new goal, start measuring again
+        h_rateGoal = h_goalState;
+        h_rateTemp = h_temp;
+        h_rateTime = now;
+    } else if (h_temp != h_rateTemp) {
+        unsigned long elapsed = now - h_rateTime;
+        if (elapsed > 0 && h_goalState != HM_Off) {
+            long rate = (long)(((long long)(h_temp - h_rateTemp) * 100 * 3600000) / (long long)elapsed);
+            if (h_isLearned[h_goalState]) {
+                h_learnedRate[h_goalState] += (rate - h_learnedRate[h_goalState]) / (1 << TTC_LEARN);
+            } else {
+                //one whole *F step is mostly rounding, start halfway from the modeled rate
+                h_learnedRate[h_goalState] = (rate + h_modeledRate(getOutputMask())) / 2;
+                h_isLearned[h_goalState] = true;
+            }
+        }
+        h_rateTemp = h_temp;
+        h_rateTime = now;
+    }
+
+    //distance to the setpoint that ends this goal state
+    long distance;
+    long direction;
+    switch (h_goalState) {
+        case HM_LowCool:
+        case HM_HighCool:
+            distance = h_temp - h_coolSetpoint;
+            direction = -1;
+            break;
+        case HM_LowHeat:
+        case HM_HighHeat:
+        case HM_MaxHeat:
+            distance = h_heatSetpoint - h_temp;
+            direction = 1;
+            break;
+        default:
+            h_timeToComfort = 0;
+            return;
+    }
+    if (distance <= 0) {
+        h_timeToComfort = 0;
+        return;
+    }
+    long rate = 0;
+    if (h_isLearned[h_goalState]) {
+        rate = h_learnedRate[h_goalState];
+    } else {
+        rate = h_modeledRate(getOutputMask());
+    }
+    rate = rate * direction;
+    if (rate <= 0) {
+        h_timeToComfort = TTC_UNKNOWN;
+        return;
+    }
+    h_timeToComfort = (long)(((long long)distance * 100 * 3600) / rate);
+    return;
+}
+
+/// @brief Modeled rate of the outputs running, from setItemRate()
+/// @param mask bit (1 << hardwareItems) set for each item running
+/// @return 1/100 *F per hour, negative cools
+long hvacLogic::h_modeledRate(unsigned int mask) {
+    long rate = 0;
+    bool reverse = (mask & (1u << HI_reversingValve)) != 0;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (!(mask & (1u << i))) continue;
+        if (i == HI_Comp1 || i == HI_Comp2) {
+            rate += reverse ? h_itemRate[i] : -h_itemRate[i];
+        } else {
+            rate += h_itemRate[i];
+        }
+    }
+    return rate;
+}
+
+/// @brief Temperature the goal is selected on, the estimator's prediction if one is set and
+/// readings still come, a stalled sensor must not run the model on alone
+/// @return *F
+int hvacLogic::h_goalTemp() {
+    if (h_estimator != NULL && !h_estimator->isStale(timeNow())) return h_estimator->getPredicted(timeNow(), h_modeledRate(getOutputMask()));
+    return h_temp;
+}
+
+/// @brief Compressor stage still waiting out hvacStageDelay(), stage 1 from the fan start, stage 2 from the comp1 start
+/// @param stage 1 or 2
+/// @return true to wait, false if the stage may start
+bool hvacLogic::h_stageWaiting(int stage) {
+    if (stage <= 1) {
+        if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + hvacStageDelay(1)) > timeNow()) return true;
+        if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + hvacStageDelay(1)) > timeNow()) return true;
+        return false;
+    }
+    //comp1 started no earlier than hvacStageDelay(1), so this is the gap between the stages
+    return h_items[HI_Comp1].isOn() && (h_items[HI_Comp1].getStartTime() + (hvacStageDelay(2) - hvacStageDelay(1))) > timeNow();
+}
+
+#define HVAC_CONTROL_BYTE(s) (byte)s,
+#define HVAC_CONTROL_ARRAY(goal, steps) static const byte hvacControl_##goal[] = {steps(HVAC_CONTROL_BYTE)};
+#define HVAC_CONTROL_POINTER(goal, steps) hvacControl_##goal,
+HVAC_CONTROL(HVAC_CONTROL_ARRAY)
+//steps of each hardwareMode for PollItems()
+static const byte *const hvacControlSteps[] = {HVAC_CONTROL(HVAC_CONTROL_POINTER)};
+static_assert(sizeof(hvacControlSteps) / sizeof(hvacControlSteps[0]) == HM_SizeOf, "HVAC_CONTROL needs the steps of every hardwareMode");
+
+/// @brief Compressors the goal state runs with the items useable now, ie: for hvacCoordinator turns.
+/// Coach heat comes before the heat pump in low and high heat, compressors need a fan
+/// @return 0 to 2
+int hvacLogic::getCompressorsWanted() {
+    int wanted = hvacCompressorsFor(h_goalState);
+    if (wanted == 0 || (!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh))) return 0;
+    if (h_goalState == HM_LowHeat || h_goalState == HM_HighHeat || h_goalState == HM_MaxHeat) {
+        if (!h_isUseable(HI_reversingValve)) return 0;
+        if (h_goalState == HM_LowHeat && h_isUseable(HI_CoachHeatLow)) return 0;
+        if (h_goalState == HM_HighHeat && h_isUseable(HI_CoachHeatHigh)) return 0;
+    }
+    return (h_isUseable(HI_Comp1) ? 1 : 0) + ((wanted > 1 && h_isUseable(HI_Comp2)) ? 1 : 0);
+}
+
+/// @brief Fans for the idle goals and single heat sources, per fan mode, off in FM_Auto
+void hvacLogic::h_fansIdle() {
+    if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
+        h_items[HI_FanLow].Stop();
+        h_items[HI_FanHigh].Stop();
+    } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
+        h_fansPrefer(HI_FanLow, HI_FanHigh);
+    } else if (h_fanMode == FM_High) {
+        h_fansPrefer(HI_FanHigh, HI_FanLow);
+    }
+    return;
+}
+
+/// @brief Runs one fan, the other if it is not useable
+/// @param want fan to run ie: HI_FanLow
+/// @param other the other fan
+void hvacLogic::h_fansPrefer(hardwareItems want, hardwareItems other) {
+    if (h_isUseable(want)) {
+        if (h_items[other].isOn()) h_items[other].Stop();
+        h_items[want].Start();
+    } else {
+        if (h_items[want].isOn()) h_items[want].Stop();
+        h_items[other].Start();
+    }
+    return;
+}
+
+/// @brief One step of the HVAC_CONTROL table, mirrored by the inline of the same name in hvacModel
+/// @param step controlStep enum value ie: CS_FansLow, not CS_End or a CS_If...
+/// @return false to end this poll, ie: waiting on a stage or the valve
+bool hvacLogic::h_controlStep(controlStep step) {
+    bool fans = h_isUseable(HI_FanLow) || h_isUseable(HI_FanHigh);
+    bool fanOn = h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn();
+    switch (step) {
+        case CS_HeatOff:
             h_items[HI_gasHeat].Stop();
             h_items[HI_CoachHeatHigh].Stop();
             h_items[HI_CoachHeatLow].Stop();
-            //stop compressors if on...
+            break;
+        case CS_CompsStop:
             h_items[HI_Comp2].Stop();
             h_items[HI_Comp1].Stop();
-            //check for reversing valve->in heat pump mode...
+            break;
+        case CS_Comp2Stop:
+            h_items[HI_Comp2].Stop();
+            break;
+        case CS_CompsStopUnlessValve:
+            //cooling, stop compressors before the valve shifts
+            if (!h_items[HI_reversingValve].isOn()) {
+                h_items[HI_Comp2].Stop();
+                h_items[HI_Comp1].Stop();
+            }
+            break;
+        case CS_ValveStop:
+            h_items[HI_reversingValve].Stop();
+            break;
+        case CS_ValveIdle:
+            //in heat pump mode, stop compressors then the valve, start over till the valve is off
             if (h_items[HI_reversingValve].isOn()) {
-                //verify that compressors are off before stop
-                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) {
-                    h_items[HI_reversingValve].Stop();
-                }
-                break; //keep starting over till valve is off...
+                h_items[HI_Comp2].Stop();
+                h_items[HI_Comp1].Stop();
+                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Stop();
+                return false;
             }
-
-            //handle fan modes
-            if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Stop();
-            } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                //want fan low
-                if (h_isUseable(HI_FanLow)) {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                } else {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                }
-            } else if (h_fanMode == FM_High) {
-                //want fan high
-                if (h_isUseable(HI_FanHigh)) {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                } else {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
+            break;
+        case CS_ValveStart:
+        case CS_ValveStartWait:
+            //valve off and available, stop compressors then shift it
+            if (!h_items[HI_reversingValve].isOn()) {
+                h_items[HI_Comp1].Stop();
+                h_items[HI_Comp2].Stop();
+                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Start();
+                if (step == CS_ValveStartWait) return false;
+            }
+            break;
+        case CS_ValveMax:
+            if (h_isUseable(HI_reversingValve)) {
+                if (!h_items[HI_reversingValve].isOn()) {
+                    h_items[HI_Comp2].Stop();
+                    h_items[HI_Comp1].Stop();
+                    if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Start();
+                    return false;
                 }
+            } else if (h_items[HI_reversingValve].isOn()) {
+                h_items[HI_Comp2].Stop();
+                h_items[HI_Comp1].Stop();
+                h_items[HI_reversingValve].Stop();
             }
             break;
-//////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        case HM_LowCool:
-            //step 0 make sure heat sources are off
+        case CS_OnlyCoachLow:
             h_items[HI_gasHeat].Stop();
             h_items[HI_CoachHeatHigh].Stop();
+            h_items[HI_CoachHeatLow].Start();
+            break;
+        case CS_OnlyCoachHigh:
+            h_items[HI_gasHeat].Stop();
             h_items[HI_CoachHeatLow].Stop();
-            //stop comp2 if on...
-            h_items[HI_Comp2].Stop();
-            //check for reversing valve->in heat pump mode...
-            if (h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp1].Stop();
-                //verify that compressors are off before stop
-                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) {
-                    h_items[HI_reversingValve].Stop();
-                }
-                break; //keep starting over till valve is off...
+            h_items[HI_CoachHeatHigh].Start();
+            break;
+        case CS_OnlyGas:
+            h_items[HI_CoachHeatLow].Stop();
+            h_items[HI_CoachHeatHigh].Stop();
+            h_items[HI_gasHeat].Start();
+            break;
+        case CS_CoachMax:
+            //coach heat high if able, low if able and high not already on, none if not
+            if (h_isUseable(HI_CoachHeatHigh)) {
+                h_items[HI_CoachHeatLow].Stop();
+                h_items[HI_CoachHeatHigh].Start();
+            } else if (h_isUseable(HI_CoachHeatLow) && !h_items[HI_CoachHeatHigh].isOn()) {
+                h_items[HI_CoachHeatHigh].Stop();
+                h_items[HI_CoachHeatLow].Start();
+            } else {
+                h_items[HI_CoachHeatLow].Stop();
+                h_items[HI_CoachHeatHigh].Stop();
             }
-            //check fans are useable, if not no compressors...
-            //handle fan modes
-            if (!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) {
+            break;
+        case CS_GasMax:
+            if (h_isUseable(HI_gasHeat)) {
+                h_items[HI_gasHeat].Start();
+            } else {
+                h_items[HI_gasHeat].Stop();
+            }
+            break;
+        case CS_FansIdle:
+            h_fansIdle();
+            break;
+        case CS_FansLow:
+            //no fans, no compressors
+            if (!fans) {
+                h_items[HI_Comp2].Stop();
                 h_items[HI_Comp1].Stop();
                 h_items[HI_FanLow].Stop();
                 h_items[HI_FanHigh].Stop();
-            } else if (h_fanMode == FM_Auto || h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                //want fan low
-                if (h_isUseable(HI_FanLow)) {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                } else {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                }
             } else if (h_fanMode == FM_High) {
-                //want fan high
-                if (h_isUseable(HI_FanHigh)) {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                } else {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                }
-            }
-            if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + F_T_C) > timeNow()) break; //fan start delay
-            if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + F_T_C) > timeNow()) break; //fan start delay
-
-            // if we get here and still no comp1, turn on...
-            if (!h_items[HI_Comp1].isOn() && h_isUseable(HI_Comp1) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn())) {
-                h_items[HI_Comp1].Start();
+                h_fansPrefer(HI_FanHigh, HI_FanLow);
+            } else {
+                h_fansPrefer(HI_FanLow, HI_FanHigh);
             }
             break;
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        case HM_HighCool:
-            //step 0 make sure heat sources are off
-            h_items[HI_gasHeat].Stop();
-            h_items[HI_CoachHeatHigh].Stop();
-            h_items[HI_CoachHeatLow].Stop();
-            //check for reversing valve->in heat pump mode...
-            if (h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp1].Stop();
+        case CS_FansHigh:
+            if (!fans) {
                 h_items[HI_Comp2].Stop();
-                //verify that compressors are off before stop
-                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) {
-                    h_items[HI_reversingValve].Stop();
-                }
-                break; //keep starting over till valve is off...
+                h_items[HI_Comp1].Stop();
+                h_items[HI_FanLow].Stop();
+                h_items[HI_FanHigh].Stop();
+            } else {
+                h_fansPrefer(HI_FanHigh, HI_FanLow);
             }
-
-            //check fans are useable, if not no compressors...
-            //handle fan modes
-            if (!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) {
+            break;
+        case CS_FansMax:
+            //no fans or valve not shifted yet, no compressors
+            if (!fans || !h_items[HI_reversingValve].isOn()) {
                 h_items[HI_Comp1].Stop();
                 h_items[HI_Comp2].Stop();
                 h_items[HI_FanLow].Stop();
                 h_items[HI_FanHigh].Stop();
-            } else if (h_isUseable(HI_FanHigh)) {
-                if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Start();
-            } else {
-                if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                h_items[HI_FanLow].Start();
+                return false;
             }
-
-            //delay before compressor start
-            if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + F_T_C) > timeNow()) break;
-            if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + F_T_C) > timeNow()) break;
-
-            // if we get here and no comp1, turn on...
-            if (!h_items[HI_Comp1].isOn() && h_isUseable(HI_Comp1) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn())) {
+            h_fansPrefer(HI_FanHigh, HI_FanLow);
+            break;
+        case CS_FansOff:
+            h_items[HI_FanLow].Stop();
+            h_items[HI_FanHigh].Stop();
+            break;
+        case CS_Stage1:
+            return !h_stageWaiting(1);
+        case CS_Stage2:
+            return !h_stageWaiting(2);
+        case CS_Comp1:
+        case CS_HeatComp1:
+            if (!h_items[HI_Comp1].isOn() && h_mayStart(HI_Comp1) && fanOn && (step == CS_Comp1 || h_items[HI_reversingValve].isOn())) {
                 h_items[HI_Comp1].Start();
             }
-
-            //delay before compressor 2 start
-            if (h_items[HI_Comp1].isOn() && (h_items[HI_Comp1].getStartTime() + C_T_C) > timeNow()) break;
-
-            //start comp2 
-            if (!h_items[HI_Comp2].isOn() && h_isUseable(HI_Comp2) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn())) {
+            break;
+        case CS_Comp2:
+        case CS_HeatComp2:
+            if (!h_items[HI_Comp2].isOn() && h_mayStart(HI_Comp2) && fanOn && (step == CS_Comp2 || h_items[HI_reversingValve].isOn())) {
                 h_items[HI_Comp2].Start();
             }
             break;
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        case HM_LowHeat:
-            if (h_isUseable(HI_CoachHeatLow)) {
-                // turn off other sources of heat and cooing
-                h_items[HI_Comp2].Stop();
-                h_items[HI_Comp1].Stop();
-                h_items[HI_reversingValve].Stop();
-                h_items[HI_gasHeat].Stop();
-                h_items[HI_CoachHeatHigh].Stop();
-                h_items[HI_CoachHeatLow].Start();
-                //handle fan modes
-                if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                    h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Stop();
-                } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                    //want fan low
-                    if (h_isUseable(HI_FanLow)) {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    } else {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    }
-                } else if (h_fanMode == FM_High) {
-                    //want fan high
-                    if (h_isUseable(HI_FanHigh)) {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    } else {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    }
-                }
-                break;
-            }
-//-----------------------------------------------------------------------------------------------------------------
-            if (h_isUseable(HI_reversingValve)) {
-                h_items[HI_Comp2].Stop();
-                h_items[HI_gasHeat].Stop();
-                h_items[HI_CoachHeatHigh].Stop();
-                h_items[HI_CoachHeatLow].Stop();
-
-                if (!h_items[HI_reversingValve].isOn()) { //reverse is off and available
-                    h_items[HI_Comp1].Stop();
-                    h_items[HI_Comp2].Stop();
-                    //verify that compressors are off before start
-                    if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Start();
-                }
-                //reverse is on and available, start fan and compressors...
-                //check fans are useable, if not no compressors...
-                //handle fan modes
-                if (!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) {
-                    h_items[HI_Comp1].Stop();
-                    h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Stop();
-                } else if (h_fanMode == FM_Auto || h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                    //want fan low
-                    if (h_isUseable(HI_FanLow)) {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    } else {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    }
-                } else if (h_fanMode == FM_High) {
-                    //want fan high
-                    if (h_isUseable(HI_FanHigh)) {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    } else {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    }
-                }
-                //fan start delay
-                if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + F_T_C) > timeNow()) break;
-                if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + F_T_C) > timeNow()) break;
-
-                // if we get here and still no comp1, turn on...
-                if (!h_items[HI_Comp1].isOn() && h_isUseable(HI_Comp1) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn()) && h_items[HI_reversingValve].isOn()) {
-                    h_items[HI_Comp1].Start();
-                }
-                break;
-            }
-//----------------------------------------------------------------------------------------------------------------------
-            // if here, nothing was available, stop everything...
-            h_items[HI_gasHeat].Stop();
-            h_items[HI_CoachHeatHigh].Stop();
-            h_items[HI_CoachHeatLow].Stop();
-            //stop compressors if on...
-            h_items[HI_Comp2].Stop();
-            h_items[HI_Comp1].Stop();
-            //check for reversing valve->in heat pump mode...
-            if (h_items[HI_reversingValve].isOn()) {
-                //verify that compressors are off before stop
-                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) {
-                    h_items[HI_reversingValve].Stop();
-                }
-                break; //keep starting over till valve is off...
-            }
-            //handle fan modes
-            if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Stop();
-            } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                //want fan low
-                if (h_isUseable(HI_FanLow)) {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                } else {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                }
-            } else if (h_fanMode == FM_High) {
-                //want fan high
-                if (h_isUseable(HI_FanHigh)) {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                } else {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                }
-            }
+        default:
             break;
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        case HM_HighHeat:
-            if (h_isUseable(HI_CoachHeatHigh)) {
-                // turn off other sources of heat and cooing
-                h_items[HI_Comp2].Stop();
-                h_items[HI_Comp1].Stop();
-                h_items[HI_reversingValve].Stop();
-                h_items[HI_gasHeat].Stop();
-                h_items[HI_CoachHeatLow].Stop();
-                h_items[HI_CoachHeatHigh].Start();
-                //handle fan modes
-                if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                    h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Stop();
-                } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                    //want fan low
-                    if (h_isUseable(HI_FanLow)) {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    } else {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    }
-                } else if (h_fanMode == FM_High) {
-                    //want fan high
-                    if (h_isUseable(HI_FanHigh)) {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    } else {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    }
-                }
-                break;
-            }
-//-----------------------------------------------------------------------------------------------------------------------
-            if (h_isUseable(HI_reversingValve)) {
-                // turn off other sources
-                h_items[HI_gasHeat].Stop();
-                h_items[HI_CoachHeatHigh].Stop();
-                h_items[HI_CoachHeatLow].Stop();
-
-                if (!h_items[HI_reversingValve].isOn()) { //reverse is off and available
-                    h_items[HI_Comp1].Stop();
-                    h_items[HI_Comp2].Stop();
-                    //verify that compressors are off before start
-                    if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Start();
-                    break;
-                }
-                //reverse is on and available, start fan and compressors...
-                //handle fan modes
-                if (!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) {
-                    h_items[HI_Comp1].Stop();
-                    h_items[HI_Comp2].Stop();
-                    h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Stop();
-                } else if (h_isUseable(HI_FanHigh)) {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                } else {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                }
-
-                //delay before compressor start
-                if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + F_T_C) > timeNow()) break;
-                if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + F_T_C) > timeNow()) break;
-
-                // if we get here and no comp1, turn on...
-                if (!h_items[HI_Comp1].isOn() && h_isUseable(HI_Comp1) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn()) && h_items[HI_reversingValve].isOn()) {
-                    h_items[HI_Comp1].Start();
-                }
-
-                //delay before compressor 2 start
-                if (h_items[HI_Comp1].isOn() && (h_items[HI_Comp1].getStartTime() + C_T_C) > timeNow()) break;
-
-                //start comp2 
-                if (!h_items[HI_Comp2].isOn() && h_isUseable(HI_Comp2) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn()) && h_items[HI_reversingValve].isOn()) {
-                    h_items[HI_Comp2].Start();
-                }
-                break;
-            }
-//---------------------------------------------------------------------------------------------------------------------------------------
-            if (h_isUseable(HI_gasHeat)) {
-                // turn off other sources of heat and cooing
-                h_items[HI_Comp2].Stop();
-                h_items[HI_Comp1].Stop();
-                h_items[HI_reversingValve].Stop();
-                h_items[HI_CoachHeatLow].Stop();
-                h_items[HI_CoachHeatHigh].Stop();
-                h_items[HI_gasHeat].Start();
-                //handle fan modes
-                if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                    h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Stop();
-                } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                    //want fan low
-                    if (h_isUseable(HI_FanLow)) {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    } else {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    }
-                } else if (h_fanMode == FM_High) {
-                    //want fan high
-                    if (h_isUseable(HI_FanHigh)) {
-                        if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                        h_items[HI_FanHigh].Start();
-                    } else {
-                        if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                        h_items[HI_FanLow].Start();
-                    }
-                }
-                break;
-            }
-//----------------------------------------------------------------------------------------------------------------------
-            // if here, nothing was available, stop everything...
-            h_items[HI_gasHeat].Stop();
-            h_items[HI_CoachHeatHigh].Stop();
-            h_items[HI_CoachHeatLow].Stop();
-            //stop compressors if on...
-            h_items[HI_Comp2].Stop();
-            h_items[HI_Comp1].Stop();
-            //check for reversing valve->in heat pump mode...
-            if (h_items[HI_reversingValve].isOn()) {
-                //verify that compressors are off before stop
-                if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) {
-                    h_items[HI_reversingValve].Stop();
-                }
-                break; //keep starting over till valve is off...
-            }
-            //handle fan modes
-            if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh)) || h_fanMode == FM_Auto) {
-                h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Stop();
-            } else if (h_fanMode == FM_Low || h_fanMode == FM_Circ) {
-                //want fan low
-                if (h_isUseable(HI_FanLow)) {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                } else {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                }
-            } else if (h_fanMode == FM_High) {
-                //want fan high
-                if (h_isUseable(HI_FanHigh)) {
-                    if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                    h_items[HI_FanHigh].Start();
-                } else {
-                    if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                    h_items[HI_FanLow].Start();
-                }
-            }
-            break;
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-        case HM_MaxHeat: //run all available heat modes same time...
-            //check reversing valve first to stop cooling...
-            if (!h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp2].Stop();
-                h_items[HI_Comp1].Stop();
-            }
-            // next start coach heat high if able, low if able, none if not
-            if (h_isUseable(HI_CoachHeatHigh)) {
-                h_items[HI_CoachHeatLow].Stop();
-                h_items[HI_CoachHeatHigh].Start();
-            } else if (h_isUseable(HI_CoachHeatLow) && !h_items[HI_CoachHeatHigh].isOn()) {
-                // try coach heat low if high not already on
-                h_items[HI_CoachHeatHigh].Stop();
-                h_items[HI_CoachHeatLow].Start();
-            } else {
-                // all coach heat disabled...
-                h_items[HI_CoachHeatLow].Stop();
-                h_items[HI_CoachHeatHigh].Stop();
-            }
-
-            // start gas heat if able or stop
-            if (h_isUseable(HI_gasHeat)) {
-                h_items[HI_gasHeat].Start();
-            } else {
-                h_items[HI_gasHeat].Stop();
-            }
-
-            // start reversing valve if able
-            if (h_isUseable(HI_reversingValve)) {
-
-                if (!h_items[HI_reversingValve].isOn()) { //reverse is off and available
-                    h_items[HI_Comp2].Stop();
-                    h_items[HI_Comp1].Stop();
-                    //verify that compressors are off before start
-                    if (!h_items[HI_Comp1].isOn() && !h_items[HI_Comp2].isOn()) h_items[HI_reversingValve].Start();
-                    break;
-                }
-            } else if (h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp2].Stop();
-                h_items[HI_Comp1].Stop();
-                h_items[HI_reversingValve].Stop();
-            }
-
-            //start fan and compressors...
-            //handle fan modes
-            if ((!h_isUseable(HI_FanLow) && !h_isUseable(HI_FanHigh) || !h_items[HI_reversingValve].isOn())) {
-                h_items[HI_Comp1].Stop();
-                h_items[HI_Comp2].Stop();
-                h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Stop();
-                break;
-            } else if (h_isUseable(HI_FanHigh)) {
-                if (h_items[HI_FanLow].isOn()) h_items[HI_FanLow].Stop();
-                h_items[HI_FanHigh].Start();
-            } else {
-                if (h_items[HI_FanHigh].isOn()) h_items[HI_FanHigh].Stop();
-                h_items[HI_FanLow].Start();
-            }
-
-            //delay before compressor start
-            if (h_items[HI_FanLow].isOn() && (h_items[HI_FanLow].getStartTime() + F_T_C) > timeNow()) break;
-            if (h_items[HI_FanHigh].isOn() && (h_items[HI_FanHigh].getStartTime() + F_T_C) > timeNow()) break;
-
-            // if we get here and no comp1, turn on...
-            if (!h_items[HI_Comp1].isOn() && h_isUseable(HI_Comp1) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn()) && h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp1].Start();
-            }
+    }
+    return true;
+}
 
-            //delay before compressor 2 start
-            if (h_items[HI_Comp1].isOn() && (h_items[HI_Comp1].getStartTime() + C_T_C) > timeNow()) break;
+/// @brief Poll computes all high level logic
+/// call very often in code. Hvac hardware modes are only changed at calc rate.
+void hvacLogic::Poll() {
+    BENCH_SCOPE(BF_LogicPoll);
+    PollItems();
+    PollGoal();
+    return;
+}
 
-            //start comp2 
-            if (!h_items[HI_Comp2].isOn() && h_isUseable(HI_Comp2) && (h_items[HI_FanLow].isOn() || h_items[HI_FanHigh].isOn()) && h_items[HI_reversingValve].isOn()) {
-                h_items[HI_Comp2].Start();
-            }
-            
-            break;
+/// @brief Advances the item state machines and drives them toward the goal state
+/// call very often, Poll() does this and PollGoal()
+void hvacLogic::PollItems() {
+    if (!h_pending.isEmpty()) h_applyPending();
+    //held starts also drop starts waiting out the restart delay, they are asked again once allowed
+    if (h_startHold) {
+        if (!h_items[HI_Comp1].isOn() && h_items[HI_Comp1].isPoll()) h_items[HI_Comp1].Stop();
+        if (!h_items[HI_Comp2].isOn() && h_items[HI_Comp2].isPoll()) h_items[HI_Comp2].Stop();
+    }
+    //Machine poll to advance state machines...
+    for (int i = 0; i < HI_SizeOf; i++) {
+        //debugI(hvacHardwareItemsNames[i]);
+        //debugI(h_items[i].isPoll());
+        //if (h_items[i].isPoll()) h_items[i].Poll();    
+        BENCH_SCOPE(BF_ItemPoll);
+        h_items[i].Poll();
+    }
+    //fanmode worker...
+    //TODO circ mode emplemented here
+    if (h_fanMode != h_userFanMode) {
+        debugI("---- FanWorker changing fan mode to: ");
+        h_fanMode = h_userFanMode;
+        h_changed(SF_FanMode);
+        debuglnI(hvacFanModeNames[h_fanMode]);
+    }
+    //hardware mode worker, the steps of the goal from the HVAC_CONTROL table...
+    const byte *steps = hvacControlSteps[h_goalState];
+    for (int i = 0; steps[i] != CS_End; i++) {
+        hardwareItems need = hvacControlIf((controlStep)steps[i]);
+        if (need == HI_SizeOf) {
+            if (!h_controlStep((controlStep)steps[i])) break; //waiting, start over next poll
+        } else if (!h_isUseable(need)) {
+            //source not useable, skip to the next one after its CS_End
+            while (steps[i] != CS_End) i++;
+        }
     }
 
-    //goal state logic
-    
+    return;
+}
+
+/// @brief Goal state selection, acts once every getLogicInterval() however often it is called.
+/// The interval is between the setLogicRate() bounds: short when temp is near a staging
+/// threshold or moving, long when it sits far inside the deadband. It keeps its own time,
+/// run from a taskScheduler with a 1 ms period so the task never drifts against the interval.
+void hvacLogic::PollGoal() {
+    if (!h_pending.isEmpty()) h_applyPending();
     if (h_nextTime > timeNow()) return; //not time yet
     //made it to the code, reset time.
-    h_nextTime = (timeNow() + LOGIC_RATE);
+    h_logicInterval = h_rateMin;
+    h_nextTime = (timeNow() + h_logicInterval);
     if (h_temp == -128) {
         debuglnI("no valid temp yet!");
         return;
     }
     hardwareMode last = h_goalState;
-
-    switch(h_currentMode) {
-    // decide cool
-    case M_Cool:
-        if (h_temp > h_coolSetpoint && h_temp <= (h_coolSetpoint + 1)) h_setGoalState(HM_LowCool); else
-        if (h_temp > (h_coolSetpoint + 1)) h_setGoalState(HM_HighCool); else
-        if (h_temp <= h_coolSetpoint) h_setGoalState(HM_Off);    
-        break;
-    // decide heat
-    case M_Heat:
-        if (h_temp < h_heatSetpoint && h_temp >= (h_heatSetpoint - 1)) h_setGoalState(HM_LowHeat); else
-        if (h_temp < (h_heatSetpoint - 1) && h_temp >= (h_heatSetpoint - 4)) h_setGoalState(HM_HighHeat); else
-        if (h_temp < (h_heatSetpoint - 4)) h_setGoalState(HM_MaxHeat); else
-        if (h_temp >= h_heatSetpoint) h_setGoalState(HM_Off);
-        break;    
-    //auto mode decide
-    case M_Auto:
-        if (h_temp > h_coolSetpoint && h_temp <= (h_coolSetpoint + 1)) h_setGoalState(HM_LowCool); else
-        if (h_temp > (h_coolSetpoint + 1)) h_setGoalState(HM_HighCool); else     
-        if (h_temp < h_heatSetpoint && h_temp >= (h_heatSetpoint - 1)) h_setGoalState(HM_LowHeat); else
-        if (h_temp < (h_heatSetpoint - 1) && h_temp >= (h_heatSetpoint - 4)) h_setGoalState(HM_HighHeat); else
-        if (h_temp < (h_heatSetpoint - 4)) h_setGoalState(HM_MaxHeat); else
-        if (h_temp >= h_heatSetpoint && h_temp <= h_coolSetpoint) h_setGoalState(HM_Off);
-        break;
-    case M_Off:
-        h_setGoalState(HM_Off);
-        break;
-    }
+    int goalTemp = h_goalTemp();
+    hardwareMode goal = hvacGoalFor(h_currentMode, goalTemp, h_heatSetpoint, h_coolSetpoint);
+    //temp alone changes the goal once every h_goalHold at most, a setting change is acted on at once
+    bool held = goal != last && !h_goalFree && (timeNow() - h_goalTime) < h_goalHold;
+    h_goalFree = false;
+    if (!held) h_setGoalState(goal);
     if (h_goalState != last) {
+        h_goalTime = timeNow();
         debugI("--- Changing Hardware mode to: ");
         debuglnI(hvacHardwareModeNames[h_goalState]);
     }
+    long timeToComfort = h_timeToComfort;
+    h_updateTimeToComfort();
+    if (h_timeToComfort != timeToComfort) h_changed(SF_TimeToComfort);
+    h_evaluations++;
+    int moved = (h_temp > h_evalTemp) ? h_temp - h_evalTemp : h_evalTemp - h_temp;
+    h_evalTemp = h_temp;
+    h_logicInterval = hvacLogicInterval(hvacGoalMargin(h_currentMode, goalTemp, h_heatSetpoint, h_coolSetpoint), moved, h_rateMin, h_rateMax);
+    //held, look again as the hold ends
+    if (held && h_goalTime + h_goalHold - timeNow() < h_logicInterval) h_logicInterval = h_goalTime + h_goalHold - timeNow();
+    h_nextTime = (timeNow() + h_logicInterval);
     return;
 
 }
@@ -87,8 +87,16 @@ extern bool isNotDisabled[HI_SizeOf];
 
 //system parameters in milliseconds
 
-//milliseconds between goal state calculations (60000)
+//milliseconds between goal state calculations at a fixed rate, the baseline for getFixedEvaluations() (60000)
 #define LOGIC_RATE 10
+//fastest goal evaluation in ms, near a staging threshold or while temp moves, not below LOGIC_RATE (60000)
+#define LOGIC_RATE_MIN 10
+//slowest goal evaluation in ms, far inside the deadband and steady, LOGIC_RATE_MIN doubled LOGIC_MARGIN - 1 times (480000)
+#define LOGIC_RATE_MAX 80
+//*F from a staging threshold from where evaluation is slowest, each *F closer halves the interval (4)
+#define LOGIC_MARGIN 4
+//least ms between two goal changes on temp alone, a faster setLogicRate() must not short cycle near a threshold (60000)
+#define LOGIC_GOAL_HOLD 10
 //Fan to Compressor start delay in milliseconds (15000)
 #define F_T_C 1000
 //Compressor to Compressor start delay in milliseconds (15000)
@@ -98,10 +106,74 @@ extern bool isNotDisabled[HI_SizeOf];
 //Reversing valve refrigerant settling time in ms (60000)
 #define R_V_D 1000
 
+//coach equipment, define as 0 in the build flags for a variant without it
+
+//Heat pump, reversing valve on the compressors (1)
+#ifndef HVAC_HAS_HEAT_PUMP
+#define HVAC_HAS_HEAT_PUMP 1
+#endif
+//Engine coolant coach heat low and high (1)
+#ifndef HVAC_HAS_COACH_HEAT
+#define HVAC_HAS_COACH_HEAT 1
+#endif
+//Second compressor (1)
+#ifndef HVAC_HAS_COMP2
+#define HVAC_HAS_COMP2 1
+#endif
+//hardwareItems bits fitted in this variant, the rest are never used
+#define HVAC_FITTED ((0xFFu) \
+                    & ~(HVAC_HAS_HEAT_PUMP ? 0u : (1u << HI_reversingValve)) \
+                    & ~(HVAC_HAS_COACH_HEAT ? 0u : ((1u << HI_CoachHeatLow) | (1u << HI_CoachHeatHigh))) \
+                    & ~(HVAC_HAS_COMP2 ? 0u : (1u << HI_Comp2)))
+
+//Compressor off time below which a start is a hard start in ms (600000)
+#define MT_HARD_START 600000
+//Wear units of a normal compressor start (100)
+#define MT_START_WEAR 100
+//Extra wear units of a start right after a stop, less the longer it was off (200)
+#define MT_HARD_WEAR 200
+
+//time to comfort model, rates in 1/100 *F per hour
+
+//Modeled cooling per compressor, heating when reversing valve is on (200)
+#define TTC_COMP 200
+//Modeled gas furnace heating (500)
+#define TTC_GAS 500
+//Modeled coach heat low heating (150)
+#define TTC_COACH_LOW 150
+//Modeled coach heat high heating (300)
+#define TTC_COACH_HIGH 300
+//Learned rate smoothing, new rate weighs 1/(2^TTC_LEARN) (3)
+#define TTC_LEARN 3
+//getTimeToComfort() value when it cannot be predicted
+#define TTC_UNKNOWN -1
+
 unsigned long timeNow();    
+#ifdef HVAC_SIM
+void setTimeNow(unsigned long ms);
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////
 
+//State machine tables, the single source for the state machines below and hvacModel.
+//_STATES lists States in order, _START/_STOP/_POLL give the new state per current state.
+//_GUARDS lists states entered only after a delay: X(state, delay, ENTER or LEAVE, timer state),
+//the delay restarts on entering or leaving the timer state. Keep in step with the GUARD_DEFINEs.
+
+#define COMPRESSOR_STATES(X) X(ST_STOP) X(ST_DELAY) X(ST_RUN)
+#define COMPRESSOR_START(X) X(ST_DELAY) X(EVENT_IGNORED) X(EVENT_IGNORED)
+#define COMPRESSOR_STOP(X) X(EVENT_IGNORED) X(ST_STOP) X(ST_STOP)
+#define COMPRESSOR_POLL(X) X(EVENT_IGNORED) X(ST_RUN) X(EVENT_IGNORED)
+#define COMPRESSOR_GUARDS(X) X(ST_RUN, C_R_D, LEAVE, ST_RUN)
+
+#define REVERSINGVALVE_STATES(X) X(ST_STOP) X(ST_DELAYON) X(ST_RUN) X(ST_DELAYOFF)
+#define REVERSINGVALVE_START(X) X(ST_DELAYON) X(EVENT_IGNORED) X(EVENT_IGNORED) X(ST_DELAYON)
+#define REVERSINGVALVE_STOP(X) X(EVENT_IGNORED) X(ST_DELAYOFF) X(ST_DELAYOFF) X(EVENT_IGNORED)
+#define REVERSINGVALVE_POLL(X) X(EVENT_IGNORED) X(ST_RUN) X(EVENT_IGNORED) X(ST_STOP)
+#define REVERSINGVALVE_GUARDS(X) X(ST_RUN, R_V_D, ENTER, ST_DELAYON) X(ST_STOP, R_V_D, ENTER, ST_DELAYOFF)
+
+#define HVAC_STATE_ENUM(s) s,
+
 /// @brief class for compressors which require minimum off time before restart
 class Compressor : public StateMachine 
 {
@@ -116,6 +188,9 @@ public:
     unsigned long getRunTime() {return m_compressorRunTime;};
     void resetRunTime() {m_compressorRunTime = 0;};
     unsigned long getStartTime() {return m_startTime;};
+    unsigned long getCycles() {return m_cycles;}; //number of starts
+    unsigned long getStartWear() {return m_startWear;}; //starts weighted by off time, MT_START_WEAR each
+    unsigned long getHardStarts() {return m_hardStarts;}; //starts within MT_HARD_START of a stop
 
 private:
     hardwareItems h_me;
@@ -126,12 +201,13 @@ private:
     unsigned long m_stopTime; //time compressor stopped
     unsigned long m_startTime; //time compressor started
     unsigned long m_compressorRunTime; //run time in seconds
+    unsigned long m_cycles; //number of starts
+    unsigned long m_startWear; //weighted starts
+    unsigned long m_hardStarts; //starts soon after a stop
 
     enum States
     {
-        ST_STOP,
-        ST_DELAY,
-        ST_RUN,
+        COMPRESSOR_STATES(HVAC_STATE_ENUM)
         ST_MAX_STATES
     };
 
@@ -162,6 +238,7 @@ public:
     unsigned long getRunTime() {return m_compressorRunTime;};
     void resetRunTime() {m_compressorRunTime = 0;};
     unsigned long getStartTime() {return m_startTime;};
+    unsigned long getCycles() {return m_cycles;}; //number of starts
 
 private:
     hardwareItems h_me;
@@ -173,13 +250,11 @@ private:
     unsigned long m_stopTime; //time reversing stopped
     unsigned long m_startTime; //time reversing started
     unsigned long m_compressorRunTime; //run time in seconds
+    unsigned long m_cycles; //number of starts
 
     enum States
     {
-        ST_STOP,
-        ST_DELAYON,
-        ST_RUN,
-        ST_DELAYOFF,
+        REVERSINGVALVE_STATES(HVAC_STATE_ENUM)
         ST_MAX_STATES
     };
 
@@ -211,6 +286,7 @@ public:
     unsigned long getRunTime() {return h_runTime;};
     unsigned long getStartTime() {return h_startTime;};
     void resetRunTime() {h_runTime = 0;};
+    unsigned long getCycles() {return h_cycles;}; //number of starts
 
 private:
     byte h_pin;
@@ -219,6 +295,7 @@ private:
     bool h_isPoll;
     unsigned long h_runTime;
     unsigned long h_startTime;
+    unsigned long h_cycles;
 };
 
 /// @brief wrapper class for the different hardware state machines
@@ -268,6 +345,19 @@ public:
         if (m_type == 2) {return m_onOff->getStartTime();}
         if (m_type == 3) {return m_reverse->getStartTime();}
     };
+    unsigned long getCycles() {
+        if (m_type == 1) {return m_compressor->getCycles();}
+        if (m_type == 2) {return m_onOff->getCycles();}
+        if (m_type == 3) {return m_reverse->getCycles();}
+    };
+    unsigned long getStartWear() {
+        if (m_type == 1) {return m_compressor->getStartWear();}
+        return getCycles() * MT_START_WEAR;
+    };
+    unsigned long getHardStarts() {
+        if (m_type == 1) {return m_compressor->getHardStarts();}
+        return 0;
+    };
 private:
     int m_type; //type of class to wrap
     Compressor* m_compressor;
@@ -276,12 +366,210 @@ private:
 };
 
 
+/// @brief Hardware goal state for a temperature, used by hvacLogic::Poll().
+/// No state or I/O so it can be checked with static_assert.
+/// @param mode system mode ie: M_Cool
+/// @param temp current temperature *F
+/// @param heatSetpoint *F
+/// @param coolSetpoint *F
+/// @return hardwareMode enum value ie: HM_HighCool
+constexpr hardwareMode hvacGoalFor(hvacMode mode, int temp, int heatSetpoint, int coolSetpoint) {
+    if (mode == M_Cool || mode == M_Auto) {
+        if (temp > coolSetpoint && temp <= (coolSetpoint + 1)) return HM_LowCool;
+        if (temp > (coolSetpoint + 1)) return HM_HighCool;
+        if (mode == M_Cool) return HM_Off;
+    }
+    if (mode == M_Heat || mode == M_Auto) {
+        if (temp < heatSetpoint && temp >= (heatSetpoint - 1)) return HM_LowHeat;
+        if (temp < (heatSetpoint - 1) && temp >= (heatSetpoint - 4)) return HM_HighHeat;
+        if (temp < (heatSetpoint - 4)) return HM_MaxHeat;
+    }
+    return HM_Off;
+}
+
+/// @brief How far temp is from changing the goal state
+/// @return *F temp must move, up or down, for hvacGoalFor() to change, at most LOGIC_MARGIN
+constexpr int hvacGoalMargin(hvacMode mode, int temp, int heatSetpoint, int coolSetpoint) {
+    for (int d = 1; d < LOGIC_MARGIN; d++) {
+        if (hvacGoalFor(mode, temp + d, heatSetpoint, coolSetpoint) != hvacGoalFor(mode, temp, heatSetpoint, coolSetpoint) ||
+            hvacGoalFor(mode, temp - d, heatSetpoint, coolSetpoint) != hvacGoalFor(mode, temp, heatSetpoint, coolSetpoint)) return d;
+    }
+    return LOGIC_MARGIN;
+}
+
+/// @brief ms until the next goal evaluation, doubles for each *F of margin, less each *F temp moved since the last one
+/// @param margin from hvacGoalMargin()
+/// @param moved *F temp changed since the last evaluation
+/// @param rateMin fastest interval ms
+/// @param rateMax slowest interval ms
+constexpr unsigned long hvacLogicInterval(int margin, int moved, unsigned long rateMin, unsigned long rateMax) {
+    return (margin - 1 - moved <= 0) ? rateMin :
+           ((rateMin << (margin - 1 - moved)) > rateMax) ? rateMax : (rateMin << (margin - 1 - moved));
+}
+
+//hvacStageDelay() of a stage that is not fitted, never reached
+#define HVAC_STAGE_NONE 0xFFFFFFFFUL
+
+/// @brief Time after the fan starts that compressor stage 1 or 2 may start, in ms
+/// @return HVAC_STAGE_NONE for stage 2 without a second compressor
+constexpr unsigned long hvacStageDelay(int stage) {
+    return (stage <= 1) ? F_T_C : (HVAC_HAS_COMP2 ? F_T_C + C_T_C : HVAC_STAGE_NONE);
+}
+
+/// @brief Compressors a goal state runs when everything fitted is useable, heat only with a heat pump
+constexpr int hvacCompressorsFor(hardwareMode hm) {
+    return (hm == HM_LowCool) ? 1 :
+           (hm == HM_HighCool) ? (HVAC_HAS_COMP2 ? 2 : 1) :
+           (hm == HM_LowHeat) ? (HVAC_HAS_HEAT_PUMP ? 1 : 0) :
+           (hm == HM_HighHeat || hm == HM_MaxHeat) ? (HVAC_HAS_HEAT_PUMP ? (HVAC_HAS_COMP2 ? 2 : 1) : 0) : 0;
+}
+
+//Control step tables, the single source for hvacLogic::PollItems() and hvacModel.
+//Each hardwareMode runs its steps in order until one ends the poll: CS_End, a stage still
+//waiting or a step that waits on the valve. CS_If... skips to after the next CS_End when
+//its item is not useable, so a heat goal tries its sources in order and ends as HM_Off.
+#define HVAC_CONTROL_STEPS(X) X(CS_End) \
+    X(CS_IfCoachLow) X(CS_IfCoachHigh) X(CS_IfValve) X(CS_IfGas) \
+    X(CS_HeatOff) X(CS_CompsStop) X(CS_Comp2Stop) X(CS_CompsStopUnlessValve) \
+    X(CS_ValveStop) X(CS_ValveIdle) X(CS_ValveStart) X(CS_ValveStartWait) X(CS_ValveMax) \
+    X(CS_OnlyCoachLow) X(CS_OnlyCoachHigh) X(CS_OnlyGas) X(CS_CoachMax) X(CS_GasMax) \
+    X(CS_FansIdle) X(CS_FansLow) X(CS_FansHigh) X(CS_FansMax) X(CS_FansOff) \
+    X(CS_Stage1) X(CS_Stage2) X(CS_Comp1) X(CS_Comp2) X(CS_HeatComp1) X(CS_HeatComp2)
+
+#define HVAC_CONTROL_ENUM(s) s,
+/// @brief Steps of the control tables, see hvacLogic::h_controlStep() for what each does
+enum controlStep {HVAC_CONTROL_STEPS(HVAC_CONTROL_ENUM) CS_SizeOf};
+
+/// @brief Item a CS_If... step needs useable
+/// @return hardwareItems enum value, HI_SizeOf for every other step
+constexpr hardwareItems hvacControlIf(controlStep step) {
+    return (step == CS_IfCoachLow) ? HI_CoachHeatLow :
+           (step == CS_IfCoachHigh) ? HI_CoachHeatHigh :
+           (step == CS_IfValve) ? HI_reversingValve :
+           (step == CS_IfGas) ? HI_gasHeat : HI_SizeOf;
+}
+
+#if HVAC_HAS_COMP2
+#define HVAC_CONTROL_STAGE2(X) X(CS_Stage2) X(CS_Comp2)
+#define HVAC_CONTROL_HEAT_STAGE2(X) X(CS_Stage2) X(CS_HeatComp2)
+#else
+#define HVAC_CONTROL_STAGE2(X)
+#define HVAC_CONTROL_HEAT_STAGE2(X)
+#endif
+#if HVAC_HAS_COACH_HEAT
+#define HVAC_CONTROL_COACH_LOW(X) X(CS_IfCoachLow) X(CS_CompsStop) X(CS_ValveStop) X(CS_OnlyCoachLow) X(CS_FansIdle) X(CS_End)
+#define HVAC_CONTROL_COACH_HIGH(X) X(CS_IfCoachHigh) X(CS_CompsStop) X(CS_ValveStop) X(CS_OnlyCoachHigh) X(CS_FansIdle) X(CS_End)
+#define HVAC_CONTROL_COACH_MAX(X) X(CS_CoachMax)
+#else
+#define HVAC_CONTROL_COACH_LOW(X)
+#define HVAC_CONTROL_COACH_HIGH(X)
+#define HVAC_CONTROL_COACH_MAX(X)
+#endif
+#if HVAC_HAS_HEAT_PUMP
+#define HVAC_CONTROL_PUMP_LOW(X) X(CS_IfValve) X(CS_Comp2Stop) X(CS_HeatOff) X(CS_ValveStart) X(CS_FansLow) X(CS_Stage1) X(CS_HeatComp1) X(CS_End)
+#define HVAC_CONTROL_PUMP_HIGH(X) X(CS_IfValve) X(CS_HeatOff) X(CS_ValveStartWait) X(CS_FansHigh) X(CS_Stage1) X(CS_HeatComp1) \
+    HVAC_CONTROL_HEAT_STAGE2(X) X(CS_End)
+#define HVAC_CONTROL_PUMP_MAX(X) X(CS_ValveMax) X(CS_FansMax) X(CS_Stage1) X(CS_HeatComp1) HVAC_CONTROL_HEAT_STAGE2(X)
+#else
+#define HVAC_CONTROL_PUMP_LOW(X)
+#define HVAC_CONTROL_PUMP_HIGH(X)
+#define HVAC_CONTROL_PUMP_MAX(X) X(CS_CompsStop) X(CS_FansOff)
+#endif
+
+#define HVAC_CONTROL_OFF(X) X(CS_HeatOff) X(CS_CompsStop) X(CS_ValveIdle) X(CS_FansIdle) X(CS_End)
+#define HVAC_CONTROL_LOW_COOL(X) X(CS_HeatOff) X(CS_Comp2Stop) X(CS_ValveIdle) X(CS_FansLow) X(CS_Stage1) X(CS_Comp1) X(CS_End)
+#define HVAC_CONTROL_HIGH_COOL(X) X(CS_HeatOff) X(CS_ValveIdle) X(CS_FansHigh) X(CS_Stage1) X(CS_Comp1) HVAC_CONTROL_STAGE2(X) X(CS_End)
+#define HVAC_CONTROL_LOW_HEAT(X) HVAC_CONTROL_COACH_LOW(X) HVAC_CONTROL_PUMP_LOW(X) HVAC_CONTROL_OFF(X)
+#define HVAC_CONTROL_HIGH_HEAT(X) HVAC_CONTROL_COACH_HIGH(X) HVAC_CONTROL_PUMP_HIGH(X) \
+    X(CS_IfGas) X(CS_CompsStop) X(CS_ValveStop) X(CS_OnlyGas) X(CS_FansIdle) X(CS_End) HVAC_CONTROL_OFF(X)
+#define HVAC_CONTROL_MAX_HEAT(X) X(CS_CompsStopUnlessValve) HVAC_CONTROL_COACH_MAX(X) X(CS_GasMax) HVAC_CONTROL_PUMP_MAX(X) X(CS_End)
+#define HVAC_CONTROL_FAN(X) X(CS_End)
+//steps of each hardwareMode, in hardwareMode order: X(goal, steps)
+#define HVAC_CONTROL(X) X(HM_Off, HVAC_CONTROL_OFF) X(HM_LowCool, HVAC_CONTROL_LOW_COOL) X(HM_HighCool, HVAC_CONTROL_HIGH_COOL) \
+    X(HM_LowHeat, HVAC_CONTROL_LOW_HEAT) X(HM_HighHeat, HVAC_CONTROL_HIGH_HEAT) X(HM_MaxHeat, HVAC_CONTROL_MAX_HEAT) \
+    X(HM_LowFan, HVAC_CONTROL_FAN) X(HM_HighFan, HVAC_CONTROL_FAN)
+
+/// @brief Status fields for change masks, bit (1ul << statusField), items have one bit each ie: SF_Output + HI_Comp1
+enum statusField {SF_Mode, 
+                    SF_FanMode, 
+                    SF_Goal, 
+                    SF_Temp, 
+                    SF_HeatSetpoint, 
+                    SF_CoolSetpoint, 
+                    SF_TimeToComfort,
+                    SF_Output = 8, //item on or off
+                    SF_Counters = SF_Output + HI_SizeOf, //item cycles or run time
+                    SF_SizeOf = SF_Counters + HI_SizeOf
+};
+static_assert(SF_SizeOf <= 32, "change mask is an unsigned long");
+//change mask with every field set
+#define SF_ALL (0xFFFFFFFFul >> (32 - SF_SizeOf))
+
+/// @brief Snapshot of controller state for status displays and telemetry
+struct hvacStatus {
+    hvacMode mode; //system mode
+    hvacFanMode fanMode; //fan mode in use
+    hardwareMode goal; //hardware goal state
+    int temp; //*F
+    int heatSetpoint; //*F
+    int coolSetpoint; //*F
+    unsigned int outputs; //bit (1 << hardwareItems) set for each item running
+    long timeToComfort; //seconds until goal setpoint, 0 at comfort, TTC_UNKNOWN
+    unsigned long generation; //change count of the controller when taken, see hvacLogic::getGeneration()
+    unsigned long changed; //statusField bits changed since the generation asked for, SF_ALL for a full snapshot
+};
+
+class tempEstimator;
+
+/// @brief Settings staged together, see hvacLogic::commit()
+class hvacTransaction
+{
+public:
+    hvacTransaction() {clear();};
+    /// @brief Drops everything staged
+    void clear() {
+        t_staged = 0;
+        t_notDisableMask = 0;
+        t_notDisable = 0;
+    };
+    /// @brief Stages system mode
+    void setMode(hvacMode mode) {t_mode = mode; t_staged |= (1ul << SF_Mode);};
+    /// @brief Stages user fan mode
+    void setFanMode(hvacFanMode mode) {t_fanMode = mode; t_staged |= (1ul << SF_FanMode);};
+    /// @brief Stages heat setpoint, checked against the cool setpoint it will have
+    void setHeatSetpoint(int temp) {t_heatSetpoint = temp; t_staged |= (1ul << SF_HeatSetpoint);};
+    /// @brief Stages cool setpoint, checked against the heat setpoint it will have
+    void setCoolSetpoint(int temp) {t_coolSetpoint = temp; t_staged |= (1ul << SF_CoolSetpoint);};
+    /// @brief Stages both setpoints
+    void setSetpoints(int heatSetpoint, int coolSetpoint) {setHeatSetpoint(heatSetpoint); setCoolSetpoint(coolSetpoint);};
+    /// @brief Stages a user disable, see hvacLogic::setNotDisable()
+    void setNotDisable(hardwareItems hi, bool set) {
+        t_notDisableMask |= (1u << hi);
+        if (set) t_notDisable |= (1u << hi);
+        else t_notDisable &= ~(1u << hi);
+    };
+    /// @brief Nothing staged
+    bool isEmpty() const {return t_staged == 0 && t_notDisableMask == 0;};
+
+private:
+    friend class hvacLogic;
+    unsigned long t_staged; //bit (1ul << statusField) for each setting staged
+    hvacMode t_mode;
+    hvacFanMode t_fanMode;
+    int t_heatSetpoint;
+    int t_coolSetpoint;
+    unsigned int t_notDisableMask; //bit (1 << hardwareItems) for each disable staged
+    unsigned int t_notDisable; //staged value of each, set if not disabled
+};
+
 /// @brief Hvac Logic class, performs all high level system logic
 class hvacLogic
 {
 public:
     hvacLogic(HvacItem *itemPtr[], bool *avail, bool *disable);
     void Poll();
+    void PollItems();
+    void PollGoal();
     /// @brief Sets temperature in *F to be used in determining current Hardware Mode
     /// @param temp computed or measured temperature in *F
     void setTemp(int temp);
@@ -320,12 +608,50 @@ public:
     /// @param hi hardwareItems enum value ie: HI_gasHeat
     /// @return true if useable, false if not.
     bool h_isUseable(hardwareItems hi) {
+        if (!(HVAC_FITTED & (1u << hi))) return false; //not fitted, folds away at compile time
         if (h_isAvailable[hi] && h_isNotDisabled[hi]) {
             return true;
         } else {
             return false;
         }
     };
+    unsigned int getOutputMask();
+    void getStatus(hvacStatus &status);
+    unsigned long getStatus(hvacStatus &status, unsigned long since);
+    unsigned long getGeneration();
+    unsigned long getChanges(unsigned long since);
+    bool commit(const hvacTransaction &transaction);
+    /// @brief A committed transaction waits for the next Poll()
+    bool isPending() {return !h_pending.isEmpty();};
+    bool setLogicRate(unsigned long rateMin, unsigned long rateMax);
+    /// @brief Least ms between two goal changes on temp alone, settings changes act at once
+    /// @param hold ms, 0 to change on every evaluation
+    void setGoalHold(unsigned long hold) {h_goalHold = hold;};
+    unsigned long getGoalHold() {return h_goalHold;};
+    /// @brief ms from the last goal evaluation to the next
+    unsigned long getLogicInterval() {return h_logicInterval;};
+    /// @brief Goal evaluations since construction
+    unsigned long getEvaluations() {return h_evaluations;};
+    /// @brief Goal evaluations a fixed LOGIC_RATE would have made in the same time
+    unsigned long getFixedEvaluations() {return (timeNow() - h_logicStart) / LOGIC_RATE;};
+    /// @brief Filters temperature readings and selects the goal on the predicted temperature, see tempEstimator.h
+    /// @param estimator updated by setTemp(), NULL for raw readings
+    void setEstimator(tempEstimator *estimator) {h_estimator = estimator;};
+    /// @brief Predicted time to reach the setpoint of the current goal, updated each logic tick
+    /// @return seconds, 0 if at comfort, TTC_UNKNOWN if temperature is not moving toward setpoint
+    long getTimeToComfort() {return h_timeToComfort;};
+    /// @brief Sets modeled capacity of an item, ie: from fitted cabin model (capacity / mass)
+    /// @param hi hardwareItems enum value ie: HI_gasHeat
+    /// @param rate 1/100 *F per hour, compressors as cooling magnitude
+    void setItemRate(hardwareItems hi, int rate) {h_itemRate[hi] = rate;};
+    /// @brief Holds off compressor starts, ie: hvacCoordinator staggering several units. Running compressors keep running
+    /// @param hold true to hold, false to allow starts
+    void setStartHold(bool hold) {h_startHold = hold;};
+    bool isStartHold() {return h_startHold;};
+    int getCompressorsWanted();
+    /// @brief Current hardware goal state
+    /// @return hardwareMode enum value ie: HM_LowCool
+    hardwareMode getGoalState() {return h_goalState;};
 
 private:
     HvacItem* h_items; //pointer to array of hardware
@@ -339,7 +665,19 @@ private:
         h_tempDelayActive = false;
         h_tempDelay = timeNow();
         h_goalState = hm;
+        h_changed(SF_Goal);
+    };
+    /// @brief Marks a status field changed in a new generation
+    /// @param field statusField enum value ie: SF_Temp
+    void h_changed(int field) {h_fieldGeneration[field] = ++h_generation;};
+    /// @brief A setting the goal depends on changed, evaluate within the fastest interval
+    void h_wake() {
+        if (h_nextTime > timeNow() + h_rateMin) h_nextTime = timeNow() + h_rateMin;
     };
+    void h_publish();
+    void h_applyPending();
+    long h_modeledRate(unsigned int mask);
+    int h_goalTemp();
     int h_temp; //current temperature in *F used for hardware mode logic
     int h_heatSetpoint; //current heat setpoint *F
     int h_coolSetpoint; //current cool setpoint *F
@@ -350,6 +688,37 @@ private:
     unsigned long h_nextTime;
     unsigned long h_tempDelay;
     bool h_tempDelayActive;
+    void h_updateTimeToComfort();
+    int h_itemRate[HI_SizeOf]; //modeled rate of each item 1/100 *F per hour
+    long h_learnedRate[HM_SizeOf]; //observed rate of each goal state 1/100 *F per hour
+    bool h_isLearned[HM_SizeOf]; //goal state has an observed rate
+    hardwareMode h_rateGoal; //goal state while measuring rate
+    int h_rateTemp; //temperature at start of rate measurement
+    unsigned long h_rateTime; //time at start of rate measurement
+    long h_timeToComfort; //seconds, see getTimeToComfort()
+    bool h_startHold; //compressor starts held, see setStartHold()
+    unsigned long h_generation; //see getGeneration()
+    unsigned long h_fieldGeneration[SF_SizeOf]; //generation each statusField last changed
+    unsigned int h_lastOutputs; //outputs at the last h_publish()
+    unsigned long h_lastCounters[HI_SizeOf]; //cycles + run time of each item at the last h_publish()
+    hvacTransaction h_pending; //committed settings for the next Poll(), see commit()
+    unsigned long h_rateMin; //fastest goal evaluation ms
+    unsigned long h_rateMax; //slowest goal evaluation ms
+    unsigned long h_logicInterval; //see getLogicInterval()
+    unsigned long h_goalHold; //see setGoalHold()
+    unsigned long h_goalTime; //timeNow() at the last goal change of PollGoal()
+    bool h_goalFree; //a setting changed, the next evaluation is not held
+    int h_evalTemp; //temp at the last goal evaluation
+    unsigned long h_evaluations;
+    unsigned long h_logicStart; //timeNow() at construction
+    tempEstimator *h_estimator; //see setEstimator()
+    /// @brief Compressor may start now: useable and starts not held
+    bool h_mayStart(hardwareItems hi) {return h_isUseable(hi) && !h_startHold;};
+    /// @brief Compressor stage still waiting out hvacStageDelay()
+    bool h_stageWaiting(int stage);
+    bool h_controlStep(controlStep step);
+    void h_fansIdle();
+    void h_fansPrefer(hardwareItems want, hardwareItems other);
 };
 
 
@@ -0,0 +1,219 @@
+/** @file hvacBench.cpp
+ *  @brief Cycle counts of the controller hot paths against per function budgets.
+ *
+ */
+
+
+
+#include "hvacBench.h"
+#include "JAHdebug.h"
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <fstream>
+#include <map>
+#endif
+
+static benchCounter benchCounters[BF_SizeOf];
+
+static const char *benchNames[BF_SizeOf] = {"LogicPoll", "ItemPoll", "CompressorStart", "CompressorStop", "CompressorPoll"};
+
+static const unsigned long benchBudgets[BF_SizeOf] = {BENCH_BUDGET_LOGIC, BENCH_BUDGET_ITEM,
+                                                      BENCH_BUDGET_COMPRESSOR, BENCH_BUDGET_COMPRESSOR, BENCH_BUDGET_COMPRESSOR};
+
+/// @brief Starts the cycle counter and clears the counts
+/// @return false if the target has no running cycle counter, ie: an emulator without a DWT
+bool benchInit() {
+    benchReset();
+    #ifdef PLATFORMIO
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        unsigned long first = benchCycles();
+        for (volatile int i = 0; i < 10; i++) {}
+        if (benchCycles() == first) {
+            debuglnI("bench: no cycle counter");
+            return false;
+        }
+    #endif
+    return true;
+}
+
+void benchReset() {
+    for (int f = 0; f < BF_SizeOf; f++) {
+        benchCounters[f].calls = 0;
+        benchCounters[f].total = 0;
+        benchCounters[f].min = 0xFFFFFFFF;
+        benchCounters[f].max = 0;
+    }
+    return;
+}
+
+/// @brief Adds one call, used by benchScope
+/// @param cycles counted for the call
+void benchAdd(benchFunction f, unsigned long cycles) {
+    benchCounter &c = benchCounters[f];
+    c.calls++;
+    c.total += cycles;
+    if (cycles < c.min) c.min = cycles;
+    if (cycles > c.max) c.max = cycles;
+    return;
+}
+
+const benchCounter &benchGet(benchFunction f) {
+    return benchCounters[f];
+}
+
+/// @brief Cycle budget of one call
+unsigned long benchBudget(benchFunction f) {
+    return benchBudgets[f];
+}
+
+/// @brief Prints a report line on Serial or stdout whatever the debug switch, the measured
+/// functions must run with debug output off or their prints are counted in the cycles
+void benchPrint(const char *line) {
+    #ifdef PLATFORMIO
+        Serial.println(line);
+    #endif
+    #ifdef WIN32
+        printf("%s\n", line);
+    #endif
+    return;
+}
+
+/// @brief Prints one line per function: calls, min, mean and max cycles, budget
+/// @return number of functions whose worst call was over budget
+int benchReport() {
+    int over = 0;
+    char line[128];
+    for (int f = 0; f < BF_SizeOf; f++) {
+        const benchCounter &c = benchCounters[f];
+        unsigned long mean = (c.calls > 0) ? (unsigned long)(c.total / c.calls) : 0;
+        bool ok = c.max <= benchBudgets[f];
+        if (!ok) over++;
+        snprintf(line, sizeof(line), "bench %s calls %lu min %lu mean %lu max %lu budget %lu %s",
+                 benchNames[f], c.calls, (c.calls > 0) ? c.min : 0, mean, c.max, benchBudgets[f], ok ? "ok" : "OVER");
+        benchPrint(line);
+    }
+    return over;
+}
+
+#ifdef HVAC_SIM
+/// @brief Runs a controller through a fixed scenario on the simulated clock
+/// cooling at both stages, off, heating at all stages and mode changes, the same work every run
+/// @param logic controller with its items, counts are cleared first
+/// @param ticks number of Poll() calls, BENCH_TICK ms apart
+void benchRun(hvacLogic &logic, unsigned long ticks) {
+    //temp and mode for each eighth of the run
+    static const int temps[8] = {80, 74, 72, 72, 60, 66, 69, 71};
+    static const hvacMode modes[8] = {M_Cool, M_Cool, M_Cool, M_Auto, M_Heat, M_Heat, M_Heat, M_Auto};
+    setTimeNow(0);
+    logic.setHeatSetpoint(70);
+    logic.setCoolSetpoint(73);
+    benchReset();
+    int last = -1;
+    for (unsigned long t = 0; t < ticks; t++) {
+        int part = (int)((t * 8) / ticks);
+        setTimeNow(t * BENCH_TICK);
+        if (part != last) {
+            logic.setMode(modes[part]);
+            logic.setTemp(temps[part]);
+            last = part;
+        }
+        logic.Poll();
+    }
+    return;
+}
+
+/// @brief Cools with temp wandering around the setpoints, the same walk for a controller at a fixed
+/// BENCH_LOGIC_RATE and one at the adaptive BENCH_LOGIC_RATE_MIN to BENCH_LOGIC_RATE_MAX with
+/// BENCH_GOAL_HOLD, Poll() every BENCH_TICK ms of simulated time, prints evaluations and goal changes of both
+/// @param fixed controller with its items, its logic rate and goal hold are set here
+/// @param adaptive second controller with its own items, likewise
+/// @param ms simulated time to run, hours for a fair count
+/// @return percent more (positive) or fewer (negative) evaluations of adaptive than fixed
+long benchLogicRate(hvacLogic &fixed, hvacLogic &adaptive, unsigned long ms) {
+    hvacLogic *logics[2] = {&fixed, &adaptive};
+    unsigned long evaluations[2];
+    unsigned long changes[2];
+    fixed.setLogicRate(BENCH_LOGIC_RATE, BENCH_LOGIC_RATE);
+    fixed.setGoalHold(0);
+    adaptive.setLogicRate(BENCH_LOGIC_RATE_MIN, BENCH_LOGIC_RATE_MAX);
+    adaptive.setGoalHold(BENCH_GOAL_HOLD);
+    for (int l = 0; l < 2; l++) {
+        hvacLogic &logic = *logics[l];
+        setTimeNow(0);
+        logic.setHeatSetpoint(70);
+        logic.setCoolSetpoint(73);
+        logic.setMode(M_Cool);
+        unsigned long before = logic.getEvaluations();
+        hardwareMode goal = logic.getGoalState();
+        changes[l] = 0;
+        unsigned long seed = 1;
+        int temp = 72;
+        logic.setTemp(temp);
+        for (unsigned long t = 0; t < ms; t += BENCH_TICK) {
+            setTimeNow(t);
+            //a step of temp every 5 minutes on average, kept between 69 and 77
+            if (t % 15000 == 0) {
+                seed = seed * 1103515245ul + 12345ul;
+                if (((seed >> 16) % 20) == 0) {
+                    temp += ((seed >> 8) & 1) ? 1 : -1;
+                    if (temp < 69) temp = 69;
+                    if (temp > 77) temp = 77;
+                    logic.setTemp(temp);
+                }
+            }
+            logic.Poll();
+            if (logic.getGoalState() != goal) {
+                goal = logic.getGoalState();
+                changes[l]++;
+            }
+        }
+        evaluations[l] = logic.getEvaluations() - before;
+    }
+    long diff = evaluations[0] > 0 ? ((long)evaluations[1] - (long)evaluations[0]) * 100 / (long)evaluations[0] : 0;
+    char line[160];
+    snprintf(line, sizeof(line), "logic rate evaluations fixed %lu adaptive %lu (%+ld%%) goal changes fixed %lu adaptive %lu",
+             evaluations[0], evaluations[1], diff, changes[0], changes[1]);
+    benchPrint(line);
+    return diff;
+}
+#endif
+
+#ifdef WIN32
+/// @brief Reads the mean cycles of each function from a saved benchReport()
+static bool benchLoad(const std::string &path, std::map<std::string, unsigned long> &means) {
+    std::ifstream in(path.c_str());
+    if (!in) return false;
+    std::string word, name;
+    unsigned long calls, min, mean;
+    while (in >> word) {
+        if (word != "bench") continue;
+        if (in >> name >> word >> calls >> word >> min >> word >> mean) means[name] = mean;
+    }
+    return !means.empty();
+}
+
+/// @brief Compares two saved benchReport() outputs, ie: of two commits
+/// @param baselinePath report of the older build
+/// @param currentPath report of the newer build
+/// @param percent mean cycles may grow this much before it counts
+/// @return functions that got slower, -1 if a report can not be read
+int benchCompare(const std::string &baselinePath, const std::string &currentPath, int percent) {
+    std::map<std::string, unsigned long> base, now;
+    if (!benchLoad(baselinePath, base) || !benchLoad(currentPath, now)) return -1;
+    int slower = 0;
+    for (std::map<std::string, unsigned long>::const_iterator i = now.begin(); i != now.end(); ++i) {
+        std::map<std::string, unsigned long>::const_iterator b = base.find(i->first);
+        if (b == base.end()) continue;
+        bool worse = (unsigned long long)i->second * 100 > (unsigned long long)b->second * (100 + percent);
+        if (worse) slower++;
+        char line[128];
+        snprintf(line, sizeof(line), "%s %lu -> %lu %s", i->first.c_str(), b->second, i->second, worse ? "SLOWER" : "");
+        benchPrint(line);
+    }
+    return slower;
+}
+#endif
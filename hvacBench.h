@@ -0,0 +1,105 @@
+/** @file hvacBench.h
+ *  @brief Cycle counts of the controller hot paths against per function budgets.
+ *
+ *  Built with -DHVAC_BENCH=1, hvacLogic::Poll(), the HvacItem dispatch
+ *  and the Compressor transitions count CPU cycles on every call:
+ *  DWT->CYCCNT on the Cortex-M target (board or an instruction set
+ *  simulator that models the DWT), the time stamp counter on the host.
+ *  benchRun() drives one controller through a fixed scenario on the
+ *  simulated clock, so runs of different commits do the same work and
+ *  their benchReport() lines can be compared with benchCompare().
+ *  benchLogicRate() counts goal evaluations and goal changes of the
+ *  adaptive logic rate against a fixed rate, both at the production
+ *  rates.
+ *  Without HVAC_BENCH the BENCH_SCOPE() points compile to nothing.
+ *
+ */
+
+
+#ifndef HVACBENCH_H
+#define HVACBENCH_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <intrin.h>
+#endif
+
+//count cycles at the BENCH_SCOPE() points, off (0)
+#ifndef HVAC_BENCH
+#define HVAC_BENCH 0
+#endif
+
+//cycle budgets per call on the STM32 target, a call over budget fails the report
+//hvacLogic::Poll() including item polls and a goal evaluation (20000)
+#define BENCH_BUDGET_LOGIC 20000
+//one HvacItem::Poll() through the type switch (1500)
+#define BENCH_BUDGET_ITEM 1500
+//Compressor::Start(), Stop() or Poll() transition map and state (1000)
+#define BENCH_BUDGET_COMPRESSOR 1000
+//ms of simulated time per benchRun() tick (100)
+#define BENCH_TICK 100
+//benchLogicRate() runs at the production LOGIC_RATE, LOGIC_RATE_MIN, LOGIC_RATE_MAX and LOGIC_GOAL_HOLD
+//whatever the test values of the build, ms (60000, 60000, 480000, 60000)
+#define BENCH_LOGIC_RATE 60000UL
+#define BENCH_LOGIC_RATE_MIN 60000UL
+#define BENCH_LOGIC_RATE_MAX 480000UL
+#define BENCH_GOAL_HOLD 60000UL
+
+/// @brief Measured functions
+enum benchFunction {BF_LogicPoll, BF_ItemPoll, BF_CompressorStart, BF_CompressorStop, BF_CompressorPoll, BF_SizeOf};
+
+/// @brief Counts of one function
+struct benchCounter {
+    unsigned long calls;
+    unsigned long long total; //cycles
+    unsigned long min;
+    unsigned long max;
+};
+
+/// @brief Cycle counter, wraps at 2^32
+inline unsigned long benchCycles() {
+    #ifdef PLATFORMIO
+        return DWT->CYCCNT;
+    #endif
+    #ifdef WIN32
+        return (unsigned long)__rdtsc();
+    #endif
+}
+
+bool benchInit();
+void benchReset();
+void benchAdd(benchFunction f, unsigned long cycles);
+const benchCounter &benchGet(benchFunction f);
+unsigned long benchBudget(benchFunction f);
+void benchPrint(const char *line);
+int benchReport();
+#ifdef HVAC_SIM
+void benchRun(hvacLogic &logic, unsigned long ticks);
+long benchLogicRate(hvacLogic &fixed, hvacLogic &adaptive, unsigned long ms);
+#endif
+#ifdef WIN32
+int benchCompare(const std::string &baselinePath, const std::string &currentPath, int percent);
+#endif
+
+/// @brief Counts the cycles from construction to the end of the scope
+class benchScope
+{
+public:
+    benchScope(benchFunction f) : b_function(f), b_start(benchCycles()) {};
+    ~benchScope() {benchAdd(b_function, benchCycles() - b_start);};
+
+private:
+    benchFunction b_function;
+    unsigned long b_start;
+};
+
+#if HVAC_BENCH
+#define BENCH_SCOPE(f) benchScope benchScope_(f)
+#else
+#define BENCH_SCOPE(f)
+#endif
+
+#endif
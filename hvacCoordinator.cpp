@@ -0,0 +1,134 @@
+/** @file hvacCoordinator.cpp
+ *  @brief Runs several hvacLogic units of one rig on a shared power budget.
+ *
+ */
+
+
+
+#include "hvacCoordinator.h"
+#include "JAHdebug.h"
+
+static const unsigned int hvacCompressorBits = (1u << HI_Comp1) | (1u << HI_Comp2);
+
+hvacCoordinator::hvacCoordinator() {
+    c_count = 0;
+    c_next = 0;
+    c_grant = -1;
+    c_grantTime = 0;
+    for (int i = 0; i < HI_SizeOf; i++) c_amps[i] = 0;
+    c_amps[HI_FanLow] = CO_FAN_AMPS;
+    c_amps[HI_FanHigh] = CO_FAN_AMPS;
+    c_amps[HI_Comp1] = CO_COMP_AMPS;
+    c_amps[HI_Comp2] = CO_COMP_AMPS;
+    c_budget = CO_BUDGET;
+    c_load = 0;
+    c_peak = 0;
+    c_lastStart = 0;
+    c_started = false;
+    c_starts = 0;
+    c_closest = 0xFFFFFFFF;
+    return;
+}
+
+/// @brief Adds a unit, its starts are held until the coordinator allows them
+/// @param unit controller with its own items
+/// @return unit index, -1 if CO_MAX_UNITS are in use
+int hvacCoordinator::addUnit(hvacLogic *unit) {
+    if (c_count >= CO_MAX_UNITS) return -1;
+    c_units[c_count] = unit;
+    c_lastOutputs[c_count] = unit->getOutputMask();
+    unit->setStartHold(true);
+    return c_count++;
+}
+
+/// @brief Current of a unit from its outputs
+/// @return 1/10 A
+int hvacCoordinator::c_unitLoad(int unit, unsigned int outputs) {
+    int load = 0;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (outputs & (1u << i)) load += c_amps[i];
+    }
+    return load;
+}
+
+/// @brief Unit wants another compressor, fewer running than its goal runs with its useable items
+bool hvacCoordinator::c_wants(int unit) {
+    int running = ((c_lastOutputs[unit] >> HI_Comp1) & 1) + ((c_lastOutputs[unit] >> HI_Comp2) & 1);
+    return running < c_units[unit]->getCompressorsWanted();
+}
+
+/// @brief Coordinates and polls every unit, call instead of each unit's Poll()
+void hvacCoordinator::Poll() {
+    unsigned long now = timeNow();
+    //load and compressor starts since the last Poll()
+    int load = 0;
+    for (int u = 0; u < c_count; u++) {
+        unsigned int outputs = c_units[u]->getOutputMask();
+        unsigned int started = outputs & ~c_lastOutputs[u] & hvacCompressorBits;
+        if (started != 0 && u == c_grant) c_grant = -1; //turn used
+        for (; started != 0; started &= started - 1) {
+            if (c_started && now - c_lastStart < c_closest) c_closest = now - c_lastStart;
+            c_lastStart = now;
+            c_started = true;
+            c_starts++;
+        }
+        c_lastOutputs[u] = outputs;
+        load += c_unitLoad(u, outputs);
+    }
+    c_load = load;
+    if (load > c_peak) c_peak = load;
+    bool room = load + c_amps[HI_Comp1] <= c_budget;
+    //the turn ends unused after CO_GRANT, when the unit no longer wants a compressor or the rig has no room
+    if (c_grant >= 0 && (now - c_grantTime >= CO_GRANT || !room || !c_wants(c_grant))) c_grant = -1;
+    //one unit may start a compressor, if the rig has room and the last start has settled
+    bool settled = !c_started || (now - c_lastStart) >= CO_STAGGER;
+    if (c_grant < 0 && settled && room) {
+        for (int i = 0; i < c_count && c_grant < 0; i++) {
+            int u = (c_next + i) % c_count;
+            if (c_wants(u)) c_grant = u;
+        }
+        if (c_grant >= 0) {
+            c_grantTime = now;
+            c_next = (c_grant + 1) % c_count;
+        }
+    }
+    for (int u = 0; u < c_count; u++) {
+        c_units[u]->setStartHold(u != c_grant);
+        c_units[u]->Poll();
+    }
+    return;
+}
+
+/// @brief Sets system mode of every unit
+void hvacCoordinator::setMode(hvacMode mode) {
+    for (int u = 0; u < c_count; u++) c_units[u]->setMode(mode);
+    return;
+}
+
+/// @brief Sets fan mode of every unit
+void hvacCoordinator::setFanMode(hvacFanMode mode) {
+    for (int u = 0; u < c_count; u++) c_units[u]->setFanMode(mode);
+    return;
+}
+
+/// @brief Sets both setpoints of every unit, validated together, applied at the next Poll()
+/// @param heatSetpoint *F
+/// @param coolSetpoint *F
+/// @return false if the pair is refused (no unit is changed) or a unit refused its commit()
+bool hvacCoordinator::setSetpoints(int heatSetpoint, int coolSetpoint) {
+    if (c_count == 0 || (coolSetpoint - 2) < heatSetpoint) {
+        debuglnI("hvacCoordinator: setpoints refused");
+        return false;
+    }
+    hvacTransaction t;
+    t.setSetpoints(heatSetpoint, coolSetpoint);
+    bool ok = true;
+    for (int u = 0; u < c_count; u++) {
+        if (!c_units[u]->commit(t)) {
+            debugI("hvacCoordinator: setpoints refused by unit ");
+            debuglnI(u);
+            ok = false;
+        }
+    }
+    return ok;
+}
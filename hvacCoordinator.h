@@ -0,0 +1,101 @@
+/** @file hvacCoordinator.h
+ *  @brief Runs several hvacLogic units of one rig on a shared power budget.
+ *
+ *  Coaches and buses with a front roof, rear roof and basement unit
+ *  share one shore power or generator feed. Every Poll() the
+ *  coordinator adds up the load of all units from their output
+ *  masks, then lets at most one unit start a compressor: it must
+ *  want one for its goal state with the items it can use, the load
+ *  plus a compressor must fit the budget and CO_STAGGER must have
+ *  passed since the last start anywhere in the rig. The unit keeps
+ *  its turn until a compressor starts or CO_GRANT passes, so a fan
+ *  to compressor delay does not waste it. Units take turns in round
+ *  robin order. All
+ *  other units have their starts held (hvacLogic::setStartHold()),
+ *  running compressors are never stopped by the coordinator.
+ *
+ *  Mode, fan mode and setpoints are the rig's and go to every unit,
+ *  each unit runs on the temperature of its own zone only, a unit
+ *  does not help a neighbouring zone. The work per Poll() is a fixed amount per
+ *  unit, units are only touched through plain calls from the one
+ *  loop that polls them, no locks.
+ *
+ */
+
+
+#ifndef HVACCOORDINATOR_H
+#define HVACCOORDINATOR_H
+
+#pragma once
+
+#include "hvac.h"
+
+//units per rig (4)
+#define CO_MAX_UNITS 4
+//milliseconds between compressor starts anywhere in the rig (10000)
+#define CO_STAGGER 500
+//milliseconds a unit keeps its turn to start, longer than F_T_C and C_T_C so staging does not lose it (30000)
+#define CO_GRANT 2500
+//rig power budget in 1/10 A, 30 A shore power (300)
+#define CO_BUDGET 300
+//compressor running current in 1/10 A (130)
+#define CO_COMP_AMPS 130
+//fan running current in 1/10 A (15)
+#define CO_FAN_AMPS 15
+
+static_assert(CO_GRANT > F_T_C && CO_GRANT > C_T_C, "a turn must outlast the staging delays");
+
+/// @brief Coordinator of several units, one per rig
+class hvacCoordinator
+{
+public:
+    hvacCoordinator();
+    int addUnit(hvacLogic *unit);
+    /// @brief Number of units added
+    int getUnits() {return c_count;};
+    void Poll();
+    void setMode(hvacMode mode);
+    void setFanMode(hvacFanMode mode);
+    bool setSetpoints(int heatSetpoint, int coolSetpoint);
+    /// @brief Temperature of a unit's zone
+    /// @param unit index returned by addUnit()
+    /// @param temp *F
+    void setZoneTemp(int unit, int temp) {c_units[unit]->setTemp(temp);};
+    /// @brief Sets the rig power budget, ie: lower on a 15 A outlet
+    /// @param budget 1/10 A
+    void setBudget(int budget) {c_budget = budget;};
+    /// @brief Sets the running current of one item, the same in every unit
+    /// @param hi hardwareItems enum value ie: HI_Comp1
+    /// @param amps 1/10 A
+    void setItemAmps(hardwareItems hi, int amps) {c_amps[hi] = amps;};
+    /// @brief Rig load at the last Poll()
+    /// @return 1/10 A
+    int getLoad() {return c_load;};
+    /// @brief Highest rig load seen
+    /// @return 1/10 A
+    int getPeakLoad() {return c_peak;};
+    /// @brief Compressor starts seen in the rig
+    unsigned long getStarts() {return c_starts;};
+    /// @brief Shortest time between two compressor starts seen, ms
+    unsigned long getClosestStarts() {return c_closest;};
+
+private:
+    int c_unitLoad(int unit, unsigned int outputs);
+    bool c_wants(int unit);
+    hvacLogic *c_units[CO_MAX_UNITS];
+    unsigned int c_lastOutputs[CO_MAX_UNITS]; //output mask at the last Poll()
+    int c_count;
+    int c_next; //unit whose turn it is to start
+    int c_grant; //unit allowed to start, -1 for none
+    unsigned long c_grantTime; //timeNow() c_grant got its turn
+    int c_amps[HI_SizeOf]; //1/10 A of each item
+    int c_budget;
+    int c_load;
+    int c_peak;
+    unsigned long c_lastStart; //timeNow() of the last compressor start
+    bool c_started; //a compressor has started since the coordinator began
+    unsigned long c_starts;
+    unsigned long c_closest;
+};
+
+#endif
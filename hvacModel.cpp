@@ -0,0 +1,416 @@
+/** @file hvacModel.cpp
+ *  @brief Writes a Promela model of the controller for the SPIN model checker.
+ *
+ */
+
+
+
+#include "hvacModel.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+/// @brief Delay a state waits for before it is entered, from the _GUARDS tables
+struct modelGuard {
+    const char *state; //guarded state
+    const char *delay; //delay define
+    const char *edge; //"ENTER" or "LEAVE"
+    const char *timer; //state restarting the delay
+};
+
+/// @brief One state machine class as tables of state names
+struct modelMachine {
+    const char *name; //class name
+    const char *var; //Promela array of instances
+    int instances;
+    const char *const *states;
+    int count;
+    const char *const *start;
+    const char *const *stop;
+    const char *const *poll;
+    const modelGuard *guards;
+    int guardCount;
+};
+
+#define MODEL_NAME(s) #s,
+#define MODEL_GUARD(state, delay, edge, timer) {#state, #delay, #edge, #timer},
+
+static const char *const compressorStates[] = {COMPRESSOR_STATES(MODEL_NAME)};
+static const char *const compressorStart[] = {COMPRESSOR_START(MODEL_NAME)};
+static const char *const compressorStop[] = {COMPRESSOR_STOP(MODEL_NAME)};
+static const char *const compressorPoll[] = {COMPRESSOR_POLL(MODEL_NAME)};
+static const modelGuard compressorGuards[] = {COMPRESSOR_GUARDS(MODEL_GUARD)};
+
+static const char *const valveStates[] = {REVERSINGVALVE_STATES(MODEL_NAME)};
+static const char *const valveStart[] = {REVERSINGVALVE_START(MODEL_NAME)};
+static const char *const valveStop[] = {REVERSINGVALVE_STOP(MODEL_NAME)};
+static const char *const valvePoll[] = {REVERSINGVALVE_POLL(MODEL_NAME)};
+static const modelGuard valveGuards[] = {REVERSINGVALVE_GUARDS(MODEL_GUARD)};
+
+#define MODEL_COUNT(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+static const modelMachine modelMachines[] = {
+    {"Compressor", "comp", 2, compressorStates, MODEL_COUNT(compressorStates),
+        compressorStart, compressorStop, compressorPoll, compressorGuards, MODEL_COUNT(compressorGuards)},
+    {"ReversingValve", "rv", 1, valveStates, MODEL_COUNT(valveStates),
+        valveStart, valveStop, valvePoll, valveGuards, MODEL_COUNT(valveGuards)}
+};
+
+/// @brief Promela name and how availability loss stops it (setAvailable), hardwareItems order
+static const char *const modelItems[HI_SizeOf][2] = {
+    {"HI_gasHeat", "gas = 0"},
+    {"HI_FanLow", "fanLow = 0"},
+    {"HI_FanHigh", "fanHigh = 0"},
+    {"HI_CoachHeatLow", "coachLow = 0"},
+    {"HI_CoachHeatHigh", "coachHigh = 0"},
+    {"HI_Comp1", "comp_Stop(0)"},
+    {"HI_Comp2", "comp_Stop(1)"},
+    {"HI_reversingValve", "rv_Stop(0)"}
+};
+
+static const char *const modelGoals[] = {"HM_Off", "HM_LowCool", "HM_HighCool", "HM_LowHeat", "HM_HighHeat", "HM_MaxHeat", "HM_LowFan", "HM_HighFan"};
+static const char *const modelModes[] = {"M_Off", "M_Cool", "M_Heat", "M_Auto"};
+static const char *const modelFanModes[] = {"FM_Auto", "FM_Low", "FM_High", "FM_Circ"};
+
+static_assert(MODEL_COUNT(modelGoals) == HM_SizeOf && MODEL_COUNT(modelModes) == M_SizeOf && MODEL_COUNT(modelFanModes) == FM_SizeOf, "model names out of step with hvac.h");
+
+//names of the HVAC_CONTROL steps, each needs its inline in modelControl
+static const char *const modelSteps[] = {HVAC_CONTROL_STEPS(MODEL_NAME)};
+static_assert(MODEL_COUNT(modelSteps) == CS_SizeOf, "model step names out of step with hvac.h");
+
+/// @brief Steps of one goal from the HVAC_CONTROL table
+struct modelGoalSteps {
+    const controlStep *steps;
+    int count;
+};
+#define MODEL_STEP(s) s,
+#define MODEL_STEP_ARRAY(goal, steps) static const controlStep modelSteps_##goal[] = {steps(MODEL_STEP)};
+#define MODEL_STEP_GOAL(goal, steps) {modelSteps_##goal, MODEL_COUNT(modelSteps_##goal)},
+HVAC_CONTROL(MODEL_STEP_ARRAY)
+static const modelGoalSteps modelGoalControl[] = {HVAC_CONTROL(MODEL_STEP_GOAL)};
+static_assert(MODEL_COUNT(modelGoalControl) == HM_SizeOf, "HVAC_CONTROL needs the steps of every hardwareMode");
+
+//setpoints the goal table is built on
+#define MODEL_HEAT 70
+#define MODEL_COOL 73
+
+/// @brief One inline per HVAC_CONTROL step, each mirrors its case in hvacLogic::h_controlStep().
+/// The order of steps per goal is generated from the HVAC_CONTROL table into control(),
+/// items use the Start/Stop/Poll inlines generated from the state machine tables
+static const char *modelControl = R"(
+#define compOn(i) (comp[i] == ST_RUN)
+#define rvOn (rv[0] == ST_RUN || rv[0] == ST_DELAYOFF)
+#define compsOff (!compOn(0) && !compOn(1))
+#define fansUse (use[HI_FanLow] || use[HI_FanHigh])
+#define fanOn (fanLow || fanHigh)
+#define mayStart(hi) (use[hi] && !hold)
+
+inline fanLowStart() { if :: !fanLow -> fanLow = 1; fanLow_T = 0 :: else -> skip fi }
+inline fanHighStart() { if :: !fanHigh -> fanHigh = 1; fanHigh_T = 0 :: else -> skip fi }
+inline fansPreferLow() { if :: use[HI_FanLow] -> fanHigh = 0; fanLowStart() :: else -> fanLow = 0; fanHighStart() fi }
+inline fansPreferHigh() { if :: use[HI_FanHigh] -> fanLow = 0; fanHighStart() :: else -> fanHigh = 0; fanLowStart() fi }
+/* setStartHold(): starts waiting out the restart delay are dropped before the items poll */
+inline dropHeldStarts() {
+    if :: hold && !compOn(0) && comp_Polling(0) -> comp_Stop(0) :: else -> skip fi;
+    if :: hold && !compOn(1) && comp_Polling(1) -> comp_Stop(1) :: else -> skip fi
+}
+
+inline CS_HeatOff() { gas = 0; coachHigh = 0; coachLow = 0 }
+inline CS_CompsStop() { comp_Stop(1); comp_Stop(0) }
+inline CS_Comp2Stop() { comp_Stop(1) }
+inline CS_CompsStopUnlessValve() { if :: !rvOn -> CS_CompsStop() :: else -> skip fi }
+inline CS_ValveStop() { rv_Stop(0) }
+inline CS_ValveIdle() { if :: rvOn -> CS_CompsStop(); if :: compsOff -> rv_Stop(0) :: else -> skip fi; goto done :: else -> skip fi }
+inline CS_ValveStart() { if :: !rvOn -> CS_CompsStop(); if :: compsOff -> rv_Start(0) :: else -> skip fi :: else -> skip fi }
+inline CS_ValveStartWait() { if :: !rvOn -> CS_CompsStop(); if :: compsOff -> rv_Start(0) :: else -> skip fi; goto done :: else -> skip fi }
+inline CS_ValveMax() {
+    if
+    :: use[HI_reversingValve] && !rvOn -> CS_CompsStop(); if :: compsOff -> rv_Start(0) :: else -> skip fi; goto done
+    :: !use[HI_reversingValve] && rvOn -> CS_CompsStop(); rv_Stop(0)
+    :: else -> skip
+    fi
+}
+inline CS_OnlyCoachLow() { gas = 0; coachHigh = 0; coachLow = 1 }
+inline CS_OnlyCoachHigh() { gas = 0; coachLow = 0; coachHigh = 1 }
+inline CS_OnlyGas() { coachLow = 0; coachHigh = 0; gas = 1 }
+inline CS_CoachMax() {
+    if
+    :: use[HI_CoachHeatHigh] -> coachLow = 0; coachHigh = 1
+    :: !use[HI_CoachHeatHigh] && use[HI_CoachHeatLow] && !coachHigh -> coachHigh = 0; coachLow = 1
+    :: else -> coachLow = 0; coachHigh = 0
+    fi
+}
+inline CS_GasMax() { gas = use[HI_gasHeat] }
+inline CS_FansIdle() {
+    if
+    :: !fansUse || fanMode == FM_Auto -> fanLow = 0; fanHigh = 0
+    :: fansUse && fanMode == FM_High -> fansPreferHigh()
+    :: else -> fansPreferLow()
+    fi
+}
+inline CS_FansLow() {
+    if
+    :: !fansUse -> CS_CompsStop(); fanLow = 0; fanHigh = 0
+    :: fansUse && fanMode == FM_High -> fansPreferHigh()
+    :: else -> fansPreferLow()
+    fi
+}
+inline CS_FansHigh() { if :: !fansUse -> CS_CompsStop(); fanLow = 0; fanHigh = 0 :: else -> fansPreferHigh() fi }
+inline CS_FansMax() { if :: !fansUse || !rvOn -> CS_CompsStop(); fanLow = 0; fanHigh = 0; goto done :: else -> fansPreferHigh() fi }
+inline CS_FansOff() { fanLow = 0; fanHigh = 0 }
+inline CS_Stage1() { if :: stage1Waiting -> goto done :: else -> skip fi }
+inline CS_Stage2() { if :: stage2Waiting -> goto done :: else -> skip fi }
+inline CS_Comp1() { if :: !compOn(0) && mayStart(HI_Comp1) && fanOn -> comp_Start(0) :: else -> skip fi }
+inline CS_Comp2() { if :: !compOn(1) && mayStart(HI_Comp2) && fanOn -> comp_Start(1) :: else -> skip fi }
+inline CS_HeatComp1() { if :: !compOn(0) && mayStart(HI_Comp1) && fanOn && rvOn -> comp_Start(0) :: else -> skip fi }
+inline CS_HeatComp2() { if :: !compOn(1) && mayStart(HI_Comp2) && fanOn && rvOn -> comp_Start(1) :: else -> skip fi }
+
+/* properties, checked between logic ticks */
+#define compRunning (compOn(0) || compOn(1))
+ltl compNeedsFan { [] (stable -> (!compRunning || fanLow || fanHigh)) }
+ltl noCompWhileValveShifts { [] (stable -> !(compRunning && (rv[0] == ST_DELAYON || rv[0] == ST_DELAYOFF))) }
+ltl noHeatWhileCooling { [] (stable -> !(compRunning && rv[0] == ST_STOP && (gas || coachLow || coachHigh))) }
+ltl noStartWhileHeld { [] (stable -> !(hold && ((compOn(0) && !wasOn[0]) || (compOn(1) && !wasOn[1])))) }
+ltl heldStartsDropped { [] (stable -> !(hold && (comp_Polling(0) || comp_Polling(1)))) }
+)";
+
+/// @brief Name of a timer restarted by a guard, ie: comp_T0
+static std::string modelTimer(const modelMachine &m, int g) {
+    return std::string(m.var) + "_T" + std::to_string(g);
+}
+
+/// @brief One alternative of an event inline, from state to new state
+static void modelTransition(std::ostream &out, const modelMachine &m, const char *from, const char *to) {
+    out << "    :: " << m.var << "[i] == " << from;
+    for (int g = 0; g < m.guardCount; g++) {
+        if (strcmp(m.guards[g].state, to) == 0) out << " && " << modelTimer(m, g) << "[i]";
+    }
+    out << " ->";
+    for (int g = 0; g < m.guardCount; g++) {
+        const modelGuard &guard = m.guards[g];
+        bool leave = strcmp(guard.edge, "LEAVE") == 0 && strcmp(guard.timer, from) == 0 && strcmp(from, to) != 0;
+        bool enter = strcmp(guard.edge, "ENTER") == 0 && strcmp(guard.timer, to) == 0;
+        if (leave || enter) out << " " << modelTimer(m, g) << "[i] = 0;";
+    }
+    //getStartTime() is set on entering run in both classes
+    if (strcmp(to, "ST_RUN") == 0) out << " " << m.var << "_S[i] = 0;";
+    out << " " << m.var << "[i] = " << to << "\n";
+    return;
+}
+
+/// @brief Inline for one event from its transition map
+static void modelEvent(std::ostream &out, const modelMachine &m, const char *event, const char *const *map) {
+    out << "inline " << m.var << "_" << event << "(i) {\n    if\n";
+    for (int s = 0; s < m.count; s++) {
+        if (strcmp(map[s], "EVENT_IGNORED") != 0) modelTransition(out, m, m.states[s], map[s]);
+    }
+    out << "    :: else -> skip\n    fi";
+    //delay states raise the same internal event as Poll on entry
+    if (strcmp(event, "Poll") != 0) out << ";\n    " << m.var << "_Poll(i)";
+    out << "\n}\n";
+    return;
+}
+
+/// @brief Condition for isPoll(), states with a Poll transition
+static void modelPolling(std::ostream &out, const modelMachine &m) {
+    out << "#define " << m.var << "_Polling(i) (0";
+    for (int s = 0; s < m.count; s++) {
+        if (strcmp(m.poll[s], "EVENT_IGNORED") != 0) out << " || " << m.var << "[i] == " << m.states[s];
+    }
+    out << ")\n";
+    return;
+}
+
+/// @brief Writes the model, check it with: spin -a hvac.pml && cc -o pan pan.c && ./pan -a -N compNeedsFan
+/// @param path output file ie: hvac.pml
+/// @return false if the file could not be written
+bool hvacModelWrite(const std::string &path) {
+    std::ostringstream out;
+    out << "/* Generated by hvacModelWrite() from the hvac.h transition tables, do not edit. */\n";
+    out << "/* Delays are regions: a timer bit is 0 while its delay runs and may become 1 at any tick. */\n\n";
+
+    //state names of all machines, shared names appear once
+    out << "mtype = {";
+    std::string seen = " ";
+    bool first = true;
+    for (const modelMachine &m : modelMachines) {
+        for (int s = 0; s < m.count; s++) {
+            std::string name = std::string(m.states[s]) + " ";
+            if (seen.find(" " + name) != std::string::npos) continue;
+            seen += name;
+            out << (first ? "" : ", ") << m.states[s];
+            first = false;
+        }
+    }
+    out << "};\n\n";
+    for (int i = 0; i < HI_SizeOf; i++) out << "#define " << modelItems[i][0] << " " << i << "\n";
+    for (int g = 0; g < MODEL_COUNT(modelGoals); g++) out << "#define " << modelGoals[g] << " " << g << "\n";
+    for (int m = 0; m < MODEL_COUNT(modelModes); m++) out << "#define " << modelModes[m] << " " << m << "\n";
+    for (int f = 0; f < MODEL_COUNT(modelFanModes); f++) out << "#define " << modelFanModes[f] << " " << f << "\n";
+    out << "\n";
+
+    //staging from hvacStageDelay(), stage 2 counts from the comp1 start as in h_stageWaiting()
+    out << "/* stage 1 waits hvacStageDelay(1) = " << hvacStageDelay(1) << " ms after the fan start */\n";
+    out << "#define stage1Waiting " << (hvacStageDelay(1) > 0 ? "((fanLow && !fanLow_T) || (fanHigh && !fanHigh_T))" : "0") << "\n";
+    if (hvacStageDelay(2) == HVAC_STAGE_NONE) {
+        out << "/* no stage 2, hvacStageDelay(2) is HVAC_STAGE_NONE */\n";
+        out << "#define stage2Waiting 1\n\n";
+    } else {
+        unsigned long gap = hvacStageDelay(2) - hvacStageDelay(1);
+        out << "/* stage 2 waits hvacStageDelay(2) - hvacStageDelay(1) = " << gap << " ms after the comp1 start */\n";
+        out << "#define stage2Waiting " << (gap > 0 ? "(compOn(0) && !comp_S[0])" : "0") << "\n\n";
+    }
+
+    for (const modelMachine &m : modelMachines) {
+        out << "/* " << m.name << " */\n";
+        out << "mtype " << m.var << "[" << m.instances << "];\n";
+        for (int g = 0; g < m.guardCount; g++) {
+            out << "bit " << modelTimer(m, g) << "[" << m.instances << "]; /* " << m.guards[g].delay
+                << " before " << m.guards[g].state << ", restarts on " << m.guards[g].edge << " " << m.guards[g].timer << " */\n";
+        }
+        out << "bit " << m.var << "_S[" << m.instances << "]; /* start delays after getStartTime() passed */\n";
+    }
+    out << "/* Hvac items, on or off */\n";
+    out << "bit gas, fanLow, fanHigh, coachLow, coachHigh;\n";
+    out << "bit fanLow_T, fanHigh_T; /* F_T_C after fan start */\n";
+    out << "bit use[" << HI_SizeOf << "]; /* h_isUseable() */\n";
+    out << "bit hold; /* setStartHold() */\n";
+    out << "bit wasOn[2]; /* compressors running at the start of the tick */\n";
+    out << "byte fanMode;\n";
+    out << "byte mode, band; /* goal table index, cleared after use */\n";
+    out << "byte goal;\n";
+    out << "bit stable; /* between logic ticks */\n\n";
+
+    for (const modelMachine &m : modelMachines) {
+        modelEvent(out, m, "Poll", m.poll);
+        modelEvent(out, m, "Start", m.start);
+        modelEvent(out, m, "Stop", m.stop);
+        modelPolling(out, m);
+        out << "\n";
+    }
+
+    //delays pass in any order
+    out << "inline clock() {\n";
+    for (const modelMachine &m : modelMachines) {
+        for (int n = 0; n < m.instances; n++) {
+            for (int g = 0; g < m.guardCount; g++) {
+                out << "    if :: " << modelTimer(m, g) << "[" << n << "] = 1 :: skip fi;\n";
+            }
+            out << "    if :: " << m.var << "_S[" << n << "] = 1 :: skip fi;\n";
+        }
+    }
+    out << "    if :: fanLow_T = 1 :: skip fi;\n";
+    out << "    if :: fanHigh_T = 1 :: skip fi\n}\n\n";
+
+    //fitted items come and go, setAvailable() stops them right away
+    out << "inline environment() {\n    skip";
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (!(HVAC_FITTED & (1u << i))) continue;
+        out << ";\n    if :: use[" << modelItems[i][0] << "] = 1 :: use[" << modelItems[i][0] << "] = 0; "
+            << modelItems[i][1] << " :: skip fi";
+    }
+    out << ";\n    if :: hold = 1 :: hold = 0 :: skip fi;\n    if";
+    for (int f = 0; f < MODEL_COUNT(modelFanModes); f++) out << " :: fanMode = " << modelFanModes[f];
+    out << " :: skip fi";
+    out << "\n}\n\n";
+
+    //hvacGoalFor() over every mode and a band for each run of temps with the same goals
+    int bands[64];
+    int bandCount = 0;
+    for (int temp = MODEL_HEAT - 20; temp <= MODEL_COOL + 20 && bandCount < MODEL_COUNT(bands); temp++) {
+        bool changed = (bandCount == 0);
+        for (int mode = M_Off; mode < M_SizeOf; mode++) {
+            if (!changed && hvacGoalFor((hvacMode)mode, temp, MODEL_HEAT, MODEL_COOL) != hvacGoalFor((hvacMode)mode, temp - 1, MODEL_HEAT, MODEL_COOL)) changed = true;
+        }
+        if (changed) bands[bandCount++] = temp;
+    }
+    out << "/* hvacGoalFor(mode, temp, " << MODEL_HEAT << ", " << MODEL_COOL << "), bands from *F";
+    for (int b = 0; b < bandCount; b++) out << " " << bands[b];
+    out << " */\n";
+    out << "#define BANDS " << bandCount << "\n";
+    out << "byte goalFor[" << M_SizeOf * bandCount << "];\n";
+    out << "inline goalTable() {\n";
+    for (int mode = M_Off; mode < M_SizeOf; mode++) {
+        for (int b = 0; b < bandCount; b++) {
+            out << "    goalFor[" << mode * bandCount + b << "] = " << modelGoals[hvacGoalFor((hvacMode)mode, bands[b], MODEL_HEAT, MODEL_COOL)] << ";\n";
+        }
+    }
+    out << "    skip\n}\n";
+    //any mode and temperature may come next, the table gives the goal
+    out << "inline chooseGoal() {\n    if";
+    for (int m = 0; m < MODEL_COUNT(modelModes); m++) out << " :: mode = " << modelModes[m];
+    out << " fi;\n    if";
+    for (int b = 0; b < bandCount; b++) out << " :: band = " << b;
+    out << " fi;\n";
+    out << "    goal = goalFor[mode * BANDS + band];\n";
+    out << "    mode = 0; band = 0\n}\n";
+
+    out << modelControl << "\n";
+
+    //control() from the HVAC_CONTROL table in the order PollItems() runs it, a CS_If...
+    //jumps past the next CS_End when its item is not useable
+    out << "inline control() {\n    if\n";
+    int skips = 0;
+    for (int g = 0; g < HM_SizeOf; g++) {
+        out << "    :: goal == " << modelGoals[g] << " ->\n        skip";
+        int open = 0;
+        for (int i = 0; i < modelGoalControl[g].count; i++) {
+            controlStep step = modelGoalControl[g].steps[i];
+            hardwareItems need = hvacControlIf(step);
+            if (need != HI_SizeOf) {
+                open = ++skips;
+                out << ";\n        if :: !use[" << modelItems[need][0] << "] -> goto skip" << open << " :: else -> skip fi";
+            } else if (step == CS_End) {
+                out << ";\n        goto done";
+                if (open) out << ";\n    skip" << open << ":\n        skip";
+                open = 0;
+            } else {
+                out << ";\n        " << modelSteps[step] << "()";
+            }
+        }
+        out << "\n";
+    }
+    out << "    fi;\ndone:\n    skip\n}\n\n";
+
+    out << "active proctype hvacLogic() {\n";
+    out << "    atomic {\n";
+    for (const modelMachine &m : modelMachines) {
+        for (int n = 0; n < m.instances; n++) out << "        " << m.var << "[" << n << "] = " << m.states[0] << ";\n";
+    }
+    for (int i = 0; i < HI_SizeOf; i++) {
+        out << "        use[" << modelItems[i][0] << "] = " << ((HVAC_FITTED & (1u << i)) ? 1 : 0) << ";\n";
+    }
+    out << "        goalTable();\n        hold = 0;\n        fanMode = FM_Auto;\n";
+    out << "        goal = HM_Off;\n        stable = 1\n    };\n";
+    out << "    do\n    :: atomic {\n";
+    out << "        stable = 0;\n";
+    out << "        wasOn[0] = compOn(0); wasOn[1] = compOn(1);\n";
+    out << "        clock();\n        environment();\n        chooseGoal();\n        dropHeldStarts();\n";
+    for (const modelMachine &m : modelMachines) {
+        for (int n = 0; n < m.instances; n++) out << "        " << m.var << "_Poll(" << n << ");\n";
+    }
+    out << "        control();\n        stable = 1\n    }\n    od\n}\n";
+
+    std::string model = out.str();
+    //every step PollItems() can run needs its inline, a step added to hvac.h alone fails here
+    for (int step = 0; step < CS_SizeOf; step++) {
+        if (step == CS_End || hvacControlIf((controlStep)step) != HI_SizeOf) continue;
+        if (strstr(modelControl, (std::string("inline ") + modelSteps[step] + "()").c_str()) == NULL) {
+            debugI("Model has no inline for step: ");
+            debuglnI(modelSteps[step]);
+            return false;
+        }
+    }
+    std::ofstream file(path.c_str(), std::ios::trunc);
+    if (!file) {
+        debugI("Model can not write: ");
+        debuglnI(path);
+        return false;
+    }
+    file << model;
+    return file.good();
+}
+#endif
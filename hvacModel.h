@@ -0,0 +1,29 @@
+/** @file hvacModel.h
+ *  @brief Writes a Promela model of the controller for the SPIN model checker.
+ *
+ *  Compressor and ReversingValve come from the same transition tables
+ *  the state machines are built from (COMPRESSOR_START and friends in
+ *  hvac.h), the goal table from hvacGoalFor(), compressor staging
+ *  from hvacStageDelay() and the steps of each hardware mode from
+ *  HVAC_CONTROL, the table hvacLogic::PollItems() runs. Time is abstracted to regions, each delay
+ *  is either still running or has passed, and passes at any step, so
+ *  SPIN checks every ordering of delays, goal changes, fan modes,
+ *  start holds and equipment availability instead of a sample.
+ *
+ */
+
+
+#ifndef HVACMODEL_H
+#define HVACMODEL_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <string>
+
+bool hvacModelWrite(const std::string &path);
+#endif
+
+#endif
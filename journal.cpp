@@ -0,0 +1,455 @@
+/** @file journal.cpp
+ *  @brief Event and transition journal of the host controller.
+ *
+ */
+
+
+
+#include "journal.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+#include <string.h>
+#include <chrono>
+
+static_assert(sizeof(journalHeader) <= JR_SECTOR, "header must fit one sector");
+static_assert(sizeof(journalBlock) <= sizeof(journalRecord), "summary must fit the first record slot");
+static_assert(JR_BLOCK >= 2 * sizeof(journalRecord), "block too small");
+static_assert(JR_BLOCK % JR_SECTOR == 0, "block must be whole sectors");
+
+hvacJournal::hvacJournal() {
+    j_file = INVALID_HANDLE_VALUE;
+    j_base = 0;
+    j_ring = NULL;
+    j_scratch = NULL;
+    j_used = 0;
+    j_outputs = 0;
+    j_usedNow = 0;
+    j_filled = 0;
+    j_written = 0;
+    j_commits = 0;
+    j_stop = false;
+    j_blocked = false;
+    j_commitMs = JR_COMMIT_MS;
+    memset(&j_last, 0, sizeof(j_last));
+    j_haveLast = false;
+    j_pending = 0;
+    j_dropped = 0;
+    j_records = 0;
+    return;
+}
+
+hvacJournal::~hvacJournal() {
+    close();
+}
+
+/// @brief Opens a journal and starts the writer, appends to an existing journal
+/// @param path journal file
+/// @param commitMs flush to disk at most this often, records newer than the last flush may be lost
+/// @return false if the file can not be opened or is not a journal
+bool hvacJournal::open(const std::string &path, unsigned long commitMs) {
+    close();
+    //unbuffered, every write is whole sectors from the page aligned ring at a block offset
+    j_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                         OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, NULL);
+    if (j_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(j_file, &size)) {
+        close();
+        return false;
+    }
+    j_ring = (char *)VirtualAlloc(NULL, (JR_BLOCKS + 1) * JR_BLOCK, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (j_ring == NULL) {
+        close();
+        return false;
+    }
+    j_scratch = j_ring + JR_BLOCKS * JR_BLOCK;
+    if (size.QuadPart == 0) {
+        journalHeader h;
+        h.magic = JOURNAL_MAGIC;
+        h.version = JOURNAL_VERSION;
+        h.recordSize = sizeof(journalRecord);
+        h.blockSize = JR_BLOCK;
+        memset(j_scratch, 0, JR_SECTOR);
+        memcpy(j_scratch, &h, sizeof(h));
+        if (!j_write(j_scratch, JR_SECTOR, 0)) {
+            close();
+            return false;
+        }
+        j_base = 1;
+        j_outputs = 0;
+    } else {
+        journalHeader h;
+        if (j_read(j_scratch, JR_SECTOR, 0) < sizeof(h)) {
+            close();
+            return false;
+        }
+        memcpy(&h, j_scratch, sizeof(h));
+        if (h.magic != JOURNAL_MAGIC || h.version != JOURNAL_VERSION ||
+            h.recordSize != sizeof(journalRecord) || h.blockSize != JR_BLOCK) {
+            debuglnI("hvacJournal: not a journal");
+            close();
+            return false;
+        }
+        //continue at the next whole block, the tail of the last one stays padding
+        j_base = (size.QuadPart + JR_BLOCK - 1) / JR_BLOCK;
+        //outputs of the last record, the first block appended counts its starts against them
+        j_outputs = 0;
+        if (j_base > 1) {
+            unsigned long got = j_read(j_scratch, JR_BLOCK, j_base - 1);
+            const journalBlock *b = (const journalBlock *)j_scratch;
+            if (got >= sizeof(journalRecord) && b->type == JT_Block) {
+                j_outputs = b->before;
+                for (unsigned long o = sizeof(journalRecord); o + sizeof(journalRecord) <= got; o += sizeof(journalRecord)) {
+                    const journalRecord *r = (const journalRecord *)(j_scratch + o);
+                    if (r->type == JT_Pad) break;
+                    j_outputs = r->outputs;
+                }
+            }
+        }
+    }
+    j_filled = 0;
+    j_written = 0;
+    j_commits = 0;
+    j_stop = false;
+    j_blocked = false;
+    j_commitMs = (commitMs > 0) ? commitMs : 1;
+    j_haveLast = false;
+    j_pending = 0;
+    j_start(0);
+    j_thread = std::thread(&hvacJournal::j_writer, this);
+    return true;
+}
+
+/// @brief Writes and flushes everything recorded, stops the writer
+void hvacJournal::close() {
+    if (j_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(j_lock);
+            j_stop = true;
+        }
+        j_wake.notify_one();
+        j_thread.join();
+    }
+    if (j_file != INVALID_HANDLE_VALUE) CloseHandle(j_file);
+    j_file = INVALID_HANDLE_VALUE;
+    if (j_ring != NULL) VirtualFree(j_ring, 0, MEM_RELEASE);
+    j_ring = NULL;
+    j_scratch = NULL;
+    return;
+}
+
+/// @brief Records the status if it changed, never blocks, call after each Poll()
+/// @param status from hvacLogic::getStatus()
+/// @param timeMs ms since 1970 UTC
+void hvacJournal::record(const hvacStatus &status, long long timeMs) {
+    if (j_ring == NULL) return;
+    journalRecord r;
+    memset(&r, 0, sizeof(r));
+    r.time = timeMs;
+    r.type = JT_Change;
+    r.mode = (unsigned char)status.mode;
+    r.fanMode = (unsigned char)status.fanMode;
+    r.goal = (unsigned char)status.goal;
+    r.temp = (status.temp < -127 || status.temp > 127) ? -128 : (signed char)status.temp;
+    r.heatSetpoint = (unsigned char)status.heatSetpoint;
+    r.coolSetpoint = (unsigned char)status.coolSetpoint;
+    r.outputs = (unsigned short)status.outputs;
+    r.timeToComfort = status.timeToComfort;
+    //time to comfort moves every Poll, it is carried along but is not a change
+    if (!j_haveLast) r.changed = 0xFF;
+    else {
+        if (r.mode != j_last.mode) r.changed |= JC_Mode;
+        if (r.fanMode != j_last.fanMode) r.changed |= JC_FanMode;
+        if (r.goal != j_last.goal) r.changed |= JC_Goal;
+        if (r.temp != j_last.temp) r.changed |= JC_Temp;
+        if (r.heatSetpoint != j_last.heatSetpoint || r.coolSetpoint != j_last.coolSetpoint) r.changed |= JC_Setpoint;
+        if (r.outputs != j_last.outputs) r.changed |= JC_Outputs;
+    }
+    bool change = r.changed != 0;
+    if (!change && j_pending == 0) return;
+    if (j_pending > 0) {
+        r.type = JT_Summary;
+        r.changed = 0xFF;
+        r.dropped = (unsigned short)((j_pending > 0xFFFF) ? 0xFFFF : j_pending);
+    }
+    j_last = r;
+    j_haveLast = true;
+    if (!j_append(r)) {
+        if (change) {
+            j_pending++;
+            j_dropped++;
+        }
+        return;
+    }
+    j_pending = 0;
+    j_records++;
+    return;
+}
+
+/// @brief Copies a record into the current block
+/// @return false if the ring is full
+bool hvacJournal::j_append(const journalRecord &r) {
+    if (j_blocked) {
+        if (j_filled.load(std::memory_order_relaxed) - j_written.load(std::memory_order_acquire) >= JR_BLOCKS) return false;
+        j_blocked = false;
+        j_start(j_filled.load(std::memory_order_relaxed));
+    }
+    char *block = j_ring + (j_filled.load(std::memory_order_relaxed) % JR_BLOCKS) * JR_BLOCK;
+    memcpy(block + j_used, &r, sizeof(r));
+    j_used += sizeof(r);
+    j_outputs = r.outputs;
+    j_usedNow.store(j_used, std::memory_order_release);
+    if (j_used + sizeof(r) > JR_BLOCK) j_publish();
+    return true;
+}
+
+/// @brief Hands the full current block to the writer and starts the next
+void hvacJournal::j_publish() {
+    unsigned long next = j_filled.load(std::memory_order_relaxed) + 1;
+    j_filled.store(next, std::memory_order_release);
+    //no lock, a missed wake only holds the write until the commit time
+    j_wake.notify_one();
+    j_usedNow.store(0, std::memory_order_release);
+    if (next - j_written.load(std::memory_order_acquire) >= JR_BLOCKS) {
+        j_blocked = true;
+        return;
+    }
+    j_start(next);
+    return;
+}
+
+/// @brief Clears a ring block for filling, the summary slot keeps only the outputs before it
+void hvacJournal::j_start(unsigned long filled) {
+    char *block = j_ring + (filled % JR_BLOCKS) * JR_BLOCK;
+    memset(block, 0, JR_BLOCK);
+    journalBlock *b = (journalBlock *)block;
+    b->type = JT_Block;
+    b->before = j_outputs;
+    j_used = sizeof(journalRecord);
+    j_usedNow.store(j_used, std::memory_order_release);
+    return;
+}
+
+/// @brief Fills in the summary slot of a block from its records
+/// @param block JR_BLOCK bytes, records past length are ignored
+static void journalSummarize(char *block, unsigned long length) {
+    journalBlock *b = (journalBlock *)block;
+    unsigned short outputs = b->before;
+    b->goals = 0;
+    b->minTemp = 127;
+    b->maxTemp = -128;
+    b->count = 0;
+    b->starts = 0;
+    b->stops = 0;
+    b->first = 0;
+    b->span = 0;
+    for (unsigned long o = sizeof(journalRecord); o + sizeof(journalRecord) <= length; o += sizeof(journalRecord)) {
+        const journalRecord *r = (const journalRecord *)(block + o);
+        if (r->type == JT_Pad) break;
+        if (b->count == 0) b->first = r->time;
+        b->span = (unsigned long)(r->time - b->first);
+        b->goals |= 1 << r->goal;
+        if (r->temp != -128) {
+            if (r->temp < b->minTemp) b->minTemp = r->temp;
+            if (r->temp > b->maxTemp) b->maxTemp = r->temp;
+        }
+        b->starts |= r->outputs & ~outputs;
+        b->stops |= outputs & ~r->outputs;
+        outputs = r->outputs;
+        b->count++;
+    }
+    return;
+}
+
+/// @brief Writes at the start of a block
+/// @param data page aligned, length a sector multiple, the file is unbuffered
+/// @param block block number in the file
+bool hvacJournal::j_write(const char *data, unsigned long length, long long block) {
+    LARGE_INTEGER offset;
+    offset.QuadPart = block * JR_BLOCK;
+    DWORD put = 0;
+    if (!SetFilePointerEx(j_file, offset, NULL, FILE_BEGIN)) return false;
+    return WriteFile(j_file, data, length, &put, NULL) && put == length;
+}
+
+/// @brief Reads from the start of a block
+/// @param data page aligned, length a sector multiple, the file is unbuffered
+/// @param block block number in the file
+/// @return bytes read, less than length at the end of the file
+unsigned long hvacJournal::j_read(char *data, unsigned long length, long long block) {
+    LARGE_INTEGER offset;
+    offset.QuadPart = block * JR_BLOCK;
+    DWORD got = 0;
+    if (!SetFilePointerEx(j_file, offset, NULL, FILE_BEGIN)) return 0;
+    if (!ReadFile(j_file, data, length, &got, NULL)) return 0;
+    return got;
+}
+
+/// @brief Writer thread, full blocks as they come, the partial block and a flush each commit
+void hvacJournal::j_writer() {
+    std::chrono::steady_clock::time_point commit = std::chrono::steady_clock::now() + std::chrono::milliseconds(j_commitMs);
+    bool dirty = false;
+    unsigned long partBlock = 0, partUsed = 0; //partial block already on disk
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(j_lock);
+            j_wake.wait_until(lock, commit, [this]() {
+                return j_stop || j_filled.load(std::memory_order_acquire) != j_written.load(std::memory_order_relaxed);
+            });
+        }
+        //stop first, every block filled before close() is then seen below
+        bool stop = j_stop;
+        unsigned long filled = j_filled.load(std::memory_order_acquire);
+        for (unsigned long w = j_written.load(std::memory_order_relaxed); w != filled; w++) {
+            journalSummarize(j_ring + (w % JR_BLOCKS) * JR_BLOCK, JR_BLOCK);
+            if (!j_write(j_ring + (w % JR_BLOCKS) * JR_BLOCK, JR_BLOCK, j_base + w)) debuglnI("hvacJournal: write failed");
+            j_written.store(w + 1, std::memory_order_release);
+            dirty = true;
+        }
+        if (!stop && std::chrono::steady_clock::now() < commit) continue;
+        //partly filled block, valid only if the producer did not move on meanwhile
+        unsigned long used = j_usedNow.load(std::memory_order_acquire);
+        if (used > sizeof(journalRecord) && j_filled.load(std::memory_order_acquire) == filled &&
+            (filled != partBlock || used != partUsed)) {
+            memcpy(j_scratch, j_ring + (filled % JR_BLOCKS) * JR_BLOCK, used);
+            unsigned long length = (used + JR_SECTOR - 1) / JR_SECTOR * JR_SECTOR;
+            memset(j_scratch + used, 0, length - used);
+            journalSummarize(j_scratch, used);
+            if (!j_write(j_scratch, length, j_base + filled)) debuglnI("hvacJournal: write failed");
+            partBlock = filled;
+            partUsed = used;
+            dirty = true;
+        }
+        if (dirty) {
+            FlushFileBuffers(j_file);
+            j_commits.fetch_add(1, std::memory_order_relaxed);
+            dirty = false;
+        }
+        if (stop) break;
+        commit = std::chrono::steady_clock::now() + std::chrono::milliseconds(j_commitMs);
+    }
+    return;
+}
+
+journalReader::journalReader() :
+    r_file(INVALID_HANDLE_VALUE),
+    r_map(NULL),
+    r_view(NULL),
+    r_size(0),
+    r_blocks(0),
+    r_read(0)
+{
+}
+
+journalReader::~journalReader() {
+    close();
+}
+
+/// @brief Maps a journal read only, may be open in an hvacJournal at the same time
+/// @param path journal file
+/// @return true if mapped and valid
+bool journalReader::open(const std::string &path) {
+    close();
+    r_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (r_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(r_file, &size) || size.QuadPart < (LONGLONG)sizeof(journalHeader)) {
+        close();
+        return false;
+    }
+    r_map = CreateFileMappingA(r_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (r_map == NULL) {
+        close();
+        return false;
+    }
+    r_view = (const char *)MapViewOfFile(r_map, FILE_MAP_READ, 0, 0, 0);
+    if (r_view == NULL) {
+        close();
+        return false;
+    }
+    const journalHeader *h = (const journalHeader *)r_view;
+    if (h->magic != JOURNAL_MAGIC || h->version != JOURNAL_VERSION ||
+        h->recordSize != sizeof(journalRecord) || h->blockSize != JR_BLOCK) {
+        debuglnI("journalReader: bad file");
+        close();
+        return false;
+    }
+    r_size = size.QuadPart;
+    //a block needs at least its summary slot
+    r_blocks = (r_size - JR_BLOCK >= (LONGLONG)sizeof(journalRecord)) ? (r_size - JR_BLOCK + JR_BLOCK - 1) / JR_BLOCK : 0;
+    r_read = 0;
+    return true;
+}
+
+void journalReader::close() {
+    if (r_view != NULL) UnmapViewOfFile(r_view);
+    if (r_map != NULL) CloseHandle(r_map);
+    if (r_file != INVALID_HANDLE_VALUE) CloseHandle(r_file);
+    r_file = INVALID_HANDLE_VALUE;
+    r_map = NULL;
+    r_view = NULL;
+    r_size = 0;
+    r_blocks = 0;
+    return;
+}
+
+/// @brief Summary of a block, touches one page of the file
+/// @param block 0 to getBlocks() - 1
+/// @return NULL if out of range
+const journalBlock *journalReader::getSummary(long long block) const {
+    if (block < 0 || block >= r_blocks) return NULL;
+    return (const journalBlock *)(r_view + (block + 1) * JR_BLOCK);
+}
+
+/// @brief Block to start reading at for a time, binary search over the summaries
+/// @param timeMs ms since 1970 UTC
+/// @return last block starting at or before timeMs, 0 if all start after it
+long long journalReader::seek(long long timeMs) const {
+    long long lo = 0, hi = r_blocks;
+    while (hi - lo > 1) {
+        long long mid = lo + (hi - lo) / 2;
+        const journalBlock *b = getSummary(mid);
+        //a block left empty by a crash has no time, it sorts with the block before
+        if (b->count == 0 || b->first <= timeMs) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/// @brief Records in a time range, ie: all compressor starts on one day
+/// @param from ms since 1970 UTC, first included
+/// @param to ms since 1970 UTC, not included
+/// @param starts output bits (1 << hardwareItems), a record matches if it turned one of them on, 0 for any record
+/// @param goals goal bits (1 << hardwareMode), a record matches if its goal is one of them, 0 for any goal
+/// @param out matching records are appended
+/// @return number of records appended
+size_t journalReader::find(long long from, long long to, unsigned int starts, unsigned int goals, std::vector<journalRecord> &out) {
+    size_t before = out.size();
+    r_read = 0;
+    for (long long block = seek(from); block < r_blocks; block++) {
+        const journalBlock *b = getSummary(block);
+        if (b->count == 0) continue;
+        if (b->first >= to) break;
+        if (b->first + (long long)b->span < from) continue;
+        if (starts != 0 && (b->starts & starts) == 0) continue;
+        if (goals != 0 && (b->goals & goals) == 0) continue;
+        r_read++;
+        const char *data = (const char *)b;
+        long long length = r_size - (block + 1) * JR_BLOCK;
+        if (length > JR_BLOCK) length = JR_BLOCK;
+        unsigned short outputs = b->before;
+        for (long long o = sizeof(journalRecord); o + (long long)sizeof(journalRecord) <= length; o += sizeof(journalRecord)) {
+            const journalRecord *r = (const journalRecord *)(data + o);
+            if (r->type == JT_Pad) break;
+            bool match = r->time >= from && r->time < to &&
+                         (starts == 0 || (r->outputs & ~outputs & starts) != 0) &&
+                         (goals == 0 || ((1u << r->goal) & goals) != 0);
+            if (match) out.push_back(*r);
+            outputs = r->outputs;
+        }
+    }
+    return out.size() - before;
+}
+#endif
@@ -0,0 +1,175 @@
+/** @file journal.h
+ *  @brief Event and transition journal of the host controller.
+ *
+ *  record() is called after each hvacLogic::Poll() and appends a
+ *  fixed size record when anything in the status changed. Records
+ *  go to a ring of large blocks in memory, a writer thread writes
+ *  each block once it is full at its own block aligned offset, and
+ *  once per commit interval also writes the partly filled block and
+ *  flushes everything written since to disk (group commit). The file
+ *  is opened unbuffered and write through, the writes are whole
+ *  sectors from the page aligned ring so they go straight to disk.
+ *  record() never waits on the writer: when the ring is full
+ *  changes are counted instead and one summary record is written
+ *  once a block is free again.
+ *
+ *  The file is a run of JR_BLOCK blocks. Block 0 holds the header,
+ *  every other block starts with a journalBlock summary of the
+ *  records in it. The summaries are a sparse time index: a reader
+ *  finds a time with a binary search over them and skips blocks
+ *  whose goal states or output starts can not match, so it reads
+ *  only the blocks holding answers. Unused space is zero and reads
+ *  as JT_Pad records.
+ *
+ */
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+//journal file magic "JRNL"
+#define JOURNAL_MAGIC 0x4C4E524A
+#define JOURNAL_VERSION 2
+//bytes per block, page multiple (65536)
+#define JR_BLOCK 65536
+//partial blocks are written rounded up to this, a multiple of the disk sector (4096)
+#define JR_SECTOR 4096
+//blocks in the ring (8)
+#define JR_BLOCKS 8
+//default group commit interval in ms (1000)
+#define JR_COMMIT_MS 1000
+
+/// @brief Record types
+enum journalType {JT_Pad = 0, JT_Change = 1, JT_Summary = 2, JT_Block = 3};
+
+/// @brief What changed since the previous record
+enum journalChange {JC_Mode = 1, JC_FanMode = 2, JC_Goal = 4, JC_Temp = 8, JC_Setpoint = 16, JC_Outputs = 32};
+
+/// @brief File header, alone in block 0
+struct journalHeader {
+    unsigned long magic; //JOURNAL_MAGIC
+    unsigned long version; //JOURNAL_VERSION
+    unsigned long recordSize; //sizeof(journalRecord)
+    unsigned long blockSize; //JR_BLOCK
+};
+
+/// @brief One change, a full status snapshot so any record stands alone
+struct journalRecord {
+    long long time; //ms since 1970 UTC
+    unsigned char type; //journalType
+    unsigned char changed; //journalChange bits, all for JT_Summary
+    unsigned char mode; //hvacMode
+    unsigned char fanMode; //hvacFanMode
+    unsigned char goal; //hardwareMode
+    signed char temp; //*F, -128 if none
+    unsigned char heatSetpoint; //*F
+    unsigned char coolSetpoint; //*F
+    unsigned short outputs; //output bitmask
+    unsigned short dropped; //JT_Summary: changes not recorded before this one
+    long timeToComfort; //seconds
+};
+
+/// @brief Summary in the first record slot of each block, filled in by the writer
+struct journalBlock {
+    long long first; //time of the first record
+    unsigned char type; //JT_Block
+    unsigned char goals; //bit (1 << hardwareMode) for each goal state recorded
+    signed char minTemp; //*F, greater than maxTemp if no temps
+    signed char maxTemp;
+    unsigned short count; //records in the block
+    unsigned short starts; //output bits turned on in the block
+    unsigned short stops; //output bits turned off in the block
+    unsigned short before; //outputs before the first record
+    unsigned long span; //ms from the first to the last record
+};
+
+/// @brief Journal writer, one per controller
+class hvacJournal
+{
+public:
+    hvacJournal();
+    ~hvacJournal();
+    bool open(const std::string &path, unsigned long commitMs = JR_COMMIT_MS);
+    void close();
+    void record(const hvacStatus &status, long long timeMs);
+    /// @brief Changes lost because the ring was full, only counted in summaries
+    unsigned long getDropped() {return j_dropped;};
+    /// @brief Records handed to the writer
+    unsigned long getRecords() {return j_records;};
+    /// @brief Group commits done, each one flush for all writes before it
+    unsigned long getCommits() {return j_commits;};
+
+private:
+    hvacJournal(const hvacJournal &);
+    hvacJournal &operator=(const hvacJournal &);
+    bool j_append(const journalRecord &r);
+    void j_publish();
+    void j_start(unsigned long filled);
+    bool j_write(const char *data, unsigned long length, long long block);
+    unsigned long j_read(char *data, unsigned long length, long long block);
+    void j_writer();
+    HANDLE j_file;
+    long long j_base; //block number in the file of ring block 0
+    char *j_ring; //JR_BLOCKS blocks of JR_BLOCK, page aligned
+    char *j_scratch; //copy of the partly filled block, JR_BLOCK
+    unsigned long j_used; //bytes filled in the current block, producer only
+    unsigned short j_outputs; //outputs of the last record appended, read back from the file on open
+    std::atomic<unsigned long> j_usedNow; //j_used as seen by the writer
+    std::atomic<unsigned long> j_filled; //blocks handed to the writer
+    std::atomic<unsigned long> j_written; //blocks written by the writer
+    std::atomic<unsigned long> j_commits;
+    std::atomic<bool> j_stop;
+    bool j_blocked; //ring full, no current block
+    unsigned long j_commitMs;
+    std::thread j_thread;
+    std::mutex j_lock;
+    std::condition_variable j_wake;
+    journalRecord j_last; //previous status recorded
+    bool j_haveLast;
+    unsigned long j_pending; //changes dropped since the last record
+    unsigned long j_dropped;
+    unsigned long j_records;
+};
+
+/// @brief Read only view of a journal for queries, maps the whole file
+class journalReader
+{
+public:
+    journalReader();
+    ~journalReader();
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const {return r_view != NULL;};
+    /// @brief Blocks holding records, numbered from 0
+    long long getBlocks() const {return r_blocks;};
+    const journalBlock *getSummary(long long block) const;
+    long long seek(long long timeMs) const;
+    size_t find(long long from, long long to, unsigned int starts, unsigned int goals, std::vector<journalRecord> &out);
+    /// @brief Blocks whose records find() read, the rest were skipped on their summary
+    long long getBlocksRead() const {return r_read;};
+
+private:
+    journalReader(const journalReader &);
+    journalReader &operator=(const journalReader &);
+    HANDLE r_file;
+    HANDLE r_map;
+    const char *r_view;
+    long long r_size; //bytes mapped
+    long long r_blocks;
+    long long r_read;
+};
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+/** @file logIngest.cpp
+ *  @brief Controller CSV log ingestion into columnar telemetry files.
+ *
+ */
+
+
+
+#include "logIngest.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOG_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//fields per CSV row
+#define LOG_FIELDS 6
+
+/// @brief Parse state of the row being scanned
+struct logRow {
+    const char *fieldStart; //first byte of current field
+    int field; //index of current field
+    bool ok; //all fields so far parsed
+    bool first; //still on first line, may be a header
+    long time;
+    float temp;
+    long heatSetpoint;
+    long coolSetpoint;
+    long mode;
+    long outputs;
+};
+
+/// @brief Index of lowest set bit, mask must not be 0
+static inline int logLowBit(unsigned int mask) {
+    #ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return (int)bit;
+    #else
+    return __builtin_ctz(mask);
+    #endif
+}
+
+/// @brief Parses a whole decimal number
+static bool logInt(const char *s, const char *e, long &value) {
+    bool negative = false;
+    if (s < e && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+    if (s == e) return false;
+    long v = 0;
+    for (; s < e; s++) {
+        unsigned int d = (unsigned int)(*s - '0');
+        if (d > 9) return false;
+        v = v * 10 + d;
+    }
+    value = negative ? -v : v;
+    return true;
+}
+
+/// @brief Parses a decimal number with optional fraction, no exponent
+static bool logFloat(const char *s, const char *e, float &value) {
+    bool negative = false;
+    if (s < e && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+    if (s == e) return false;
+    long whole = 0;
+    long frac = 0;
+    long scale = 1;
+    bool point = false;
+    for (; s < e; s++) {
+        if (*s == '.' && !point) {
+            point = true;
+            continue;
+        }
+        unsigned int d = (unsigned int)(*s - '0');
+        if (d > 9) return false;
+        if (!point) {
+            whole = whole * 10 + d;
+        } else if (scale < 100000) {
+            frac = frac * 10 + d;
+            scale = scale * 10;
+        }
+    }
+    float v = (float)whole + (float)frac / (float)scale;
+    value = negative ? -v : v;
+    return true;
+}
+
+/// @brief Parses hvacMode as number or name from hvacModeNames
+static bool logMode(const char *s, const char *e, long &value) {
+    if (s == e) return false;
+    switch (*s) {
+        case 'O': case 'o': value = M_Off; return true;
+        case 'C': case 'c': value = M_Cool; return true;
+        case 'H': case 'h': value = M_Heat; return true;
+        case 'A': case 'a': value = M_Auto; return true;
+    }
+    return logInt(s, e, value) && value >= 0 && value < M_SizeOf;
+}
+
+/// @brief Handles one delimiter found at data[pos], parses the field before it
+static void logDelimiter(const char *data, size_t pos, logRow &row, telemetryColumns &cols) {
+    const char *s = row.fieldStart;
+    const char *e = data + pos;
+    if (e > s && e[-1] == '\r') e--;
+    if (row.ok) {
+        switch (row.field) {
+            case 0: row.ok = logInt(s, e, row.time) && row.time >= 0; break;
+            case 1: row.ok = logFloat(s, e, row.temp); break;
+            case 2: row.ok = logInt(s, e, row.heatSetpoint); break;
+            case 3: row.ok = logInt(s, e, row.coolSetpoint); break;
+            case 4: row.ok = logMode(s, e, row.mode); break;
+            case 5: row.ok = logInt(s, e, row.outputs) && row.outputs >= 0 && row.outputs < (1 << HI_SizeOf); break;
+            default: row.ok = false; break;
+        }
+    }
+    row.field++;
+    row.fieldStart = data + pos + 1;
+    if (data[pos] != '\n') return;
+
+    //end of row
+    if (row.ok && row.field == LOG_FIELDS) {
+        cols.time.push_back((unsigned long)row.time);
+        cols.temp.push_back(row.temp);
+        cols.heatSetpoint.push_back((short)row.heatSetpoint);
+        cols.coolSetpoint.push_back((short)row.coolSetpoint);
+        cols.mode.push_back((unsigned char)row.mode);
+        cols.outputs.push_back((unsigned char)row.outputs);
+    } else if (!row.first && row.field > 1) {
+        cols.badRows++; //blank lines and the header are not counted
+    }
+    row.first = false;
+    row.field = 0;
+    row.ok = true;
+    return;
+}
+
+void telemetryColumns::clear() {
+    time.clear();
+    temp.clear();
+    heatSetpoint.clear();
+    coolSetpoint.clear();
+    mode.clear();
+    outputs.clear();
+    badRows = 0;
+    return;
+}
+
+/// @brief Parses CSV log text, appending rows to cols
+/// @param data CSV text
+/// @param length bytes in data
+/// @param cols columns to append to
+/// @return true if any row parsed
+bool logParse(const char *data, size_t length, telemetryColumns &cols) {
+    size_t before = cols.size();
+    //rough row count guess, avoids most regrowth
+    size_t guess = before + length / 32;
+    cols.time.reserve(guess);
+    cols.temp.reserve(guess);
+    cols.heatSetpoint.reserve(guess);
+    cols.coolSetpoint.reserve(guess);
+    cols.mode.reserve(guess);
+    cols.outputs.reserve(guess);
+
+    logRow row;
+    row.fieldStart = data;
+    row.field = 0;
+    row.ok = true;
+    row.first = true;
+    size_t pos = 0;
+    #ifdef LOG_SSE2
+    //find ',' and '\n' in 16 bytes at once, visit only the hits
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + pos));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, comma), _mm_cmpeq_epi8(block, newline)));
+        while (mask) {
+            logDelimiter(data, pos + logLowBit(mask), row, cols);
+            mask &= mask - 1;
+        }
+    }
+    #endif
+    for (; pos < length; pos++) {
+        if (data[pos] == ',' || data[pos] == '\n') logDelimiter(data, pos, row, cols);
+    }
+    //last row without newline
+    if (row.fieldStart < data + length) {
+        //parse the tail as if a newline followed it
+        std::string tail(row.fieldStart, data + length);
+        tail.push_back('\n');
+        row.fieldStart = tail.data();
+        logDelimiter(tail.data(), tail.size() - 1, row, cols);
+    }
+    return cols.size() > before;
+}
+
+/// @brief Maps a whole file read only and parses it
+static bool logParseFile(const std::string &path, telemetryColumns &cols) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void *view = (map != NULL) ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+    bool ok = false;
+    if (view != NULL) {
+        ok = logParse((const char *)view, (size_t)size.QuadPart, cols);
+        UnmapViewOfFile(view);
+    }
+    if (map != NULL) CloseHandle(map);
+    CloseHandle(file);
+    return ok;
+}
+
+/// @brief Writes columns as a telemetry file
+/// @param path output file
+/// @param cols columns, all the same length
+/// @return true if succesful
+bool logWriteColumns(const std::string &path, const telemetryColumns &cols) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    telemetryHeader h;
+    h.magic = TELEMETRY_MAGIC;
+    h.version = TELEMETRY_VERSION;
+    h.rows = (unsigned long)cols.size();
+    h.badRows = cols.badRows;
+    out.write((const char *)&h, sizeof(h));
+    if (h.rows > 0) {
+        out.write((const char *)&cols.time[0], h.rows * sizeof(cols.time[0]));
+        out.write((const char *)&cols.temp[0], h.rows * sizeof(cols.temp[0]));
+        out.write((const char *)&cols.heatSetpoint[0], h.rows * sizeof(cols.heatSetpoint[0]));
+        out.write((const char *)&cols.coolSetpoint[0], h.rows * sizeof(cols.coolSetpoint[0]));
+        out.write((const char *)&cols.mode[0], h.rows * sizeof(cols.mode[0]));
+        out.write((const char *)&cols.outputs[0], h.rows * sizeof(cols.outputs[0]));
+    }
+    return out.good();
+}
+
+/// @brief Reads a telemetry file written by logWriteColumns()
+/// @param path telemetry file
+/// @param cols receives the columns
+/// @return true if succesful, false if the file is not rows columns long
+bool logReadColumns(const std::string &path, telemetryColumns &cols) {
+    cols.clear();
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) return false;
+    telemetryHeader h;
+    in.read((char *)&h, sizeof(h));
+    if (!in || h.magic != TELEMETRY_MAGIC || h.version != TELEMETRY_VERSION) return false;
+    //the columns must be in the file before anything is sized from a header that may be damaged
+    unsigned long long width = sizeof(cols.time[0]) + sizeof(cols.temp[0]) + sizeof(cols.heatSetpoint[0]) +
+                               sizeof(cols.coolSetpoint[0]) + sizeof(cols.mode[0]) + sizeof(cols.outputs[0]);
+    in.seekg(0, std::ios::end);
+    unsigned long long size = (unsigned long long)in.tellg();
+    in.seekg(sizeof(h), std::ios::beg);
+    if (!in || size < sizeof(h) || (unsigned long long)h.rows * width != size - sizeof(h)) {
+        debuglnI("logReadColumns: size does not match the header");
+        return false;
+    }
+    cols.time.resize(h.rows);
+    cols.temp.resize(h.rows);
+    cols.heatSetpoint.resize(h.rows);
+    cols.coolSetpoint.resize(h.rows);
+    cols.mode.resize(h.rows);
+    cols.outputs.resize(h.rows);
+    cols.badRows = h.badRows;
+    if (h.rows > 0) {
+        in.read((char *)&cols.time[0], h.rows * sizeof(cols.time[0]));
+        in.read((char *)&cols.temp[0], h.rows * sizeof(cols.temp[0]));
+        in.read((char *)&cols.heatSetpoint[0], h.rows * sizeof(cols.heatSetpoint[0]));
+        in.read((char *)&cols.coolSetpoint[0], h.rows * sizeof(cols.coolSetpoint[0]));
+        in.read((char *)&cols.mode[0], h.rows * sizeof(cols.mode[0]));
+        in.read((char *)&cols.outputs[0], h.rows * sizeof(cols.outputs[0]));
+    }
+    return in.good();
+}
+
+/// @brief Converts CSV logs to telemetry files (path + ".tlm"), files in parallel
+/// @param csvPaths CSV log files
+/// @param threads worker threads, 0 for hardware concurrency
+/// @return number of files converted
+int logIngest(const std::vector<std::string> &csvPaths, int threads) {
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    if (threads > (int)csvPaths.size()) threads = (int)csvPaths.size();
+    std::atomic<size_t> next(0);
+    std::atomic<int> done(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&]() {
+            telemetryColumns cols;
+            for (size_t i = next++; i < csvPaths.size(); i = next++) {
+                cols.clear();
+                if (logParseFile(csvPaths[i], cols) && logWriteColumns(csvPaths[i] + ".tlm", cols)) done++;
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    debugI("logIngest files converted: ");
+    debuglnI(done.load());
+    return done.load();
+}
+#endif
@@ -0,0 +1,57 @@
+/** @file logIngest.h
+ *  @brief Controller CSV log ingestion into columnar telemetry files.
+ *
+ *  Coach logs are CSV rows of
+ *      time,temp,heatSetpoint,coolSetpoint,mode,outputs
+ *  time in seconds, temp in *F, mode as number or hvacModeNames
+ *  text, outputs as the hvacLogic::getOutputMask() value.
+ *  Delimiters are found 16 bytes at a time with SSE2 and files
+ *  are converted in parallel.
+ *
+ */
+
+
+#ifndef LOGINGEST_H
+#define LOGINGEST_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <string>
+#include <vector>
+
+//columnar file magic "TLMC"
+#define TELEMETRY_MAGIC 0x434D4C54
+#define TELEMETRY_VERSION 1
+
+/// @brief Columnar file header, followed by each column for all rows in turn
+struct telemetryHeader {
+    unsigned long magic; //TELEMETRY_MAGIC
+    unsigned long version; //TELEMETRY_VERSION
+    unsigned long rows; //number of rows in every column
+    unsigned long badRows; //rows skipped while parsing
+};
+
+/// @brief Telemetry held as one vector per field
+struct telemetryColumns {
+    std::vector<unsigned long> time; //seconds
+    std::vector<float> temp; //*F
+    std::vector<short> heatSetpoint; //*F
+    std::vector<short> coolSetpoint; //*F
+    std::vector<unsigned char> mode; //hvacMode
+    std::vector<unsigned char> outputs; //output bitmask
+    unsigned long badRows; //rows skipped while parsing
+    telemetryColumns() : badRows(0) {};
+    void clear();
+    size_t size() const {return time.size();};
+};
+
+bool logParse(const char *data, size_t length, telemetryColumns &cols);
+bool logReadColumns(const std::string &path, telemetryColumns &cols);
+bool logWriteColumns(const std::string &path, const telemetryColumns &cols);
+int logIngest(const std::vector<std::string> &csvPaths, int threads);
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+/** @file maintenance.cpp
+ *  @brief Wear accounting and maintenance reminders.
+ *
+ */
+
+
+
+#include "maintenance.h"
+#include "JAHdebug.h"
+
+#include <string.h>
+
+/// @brief Checksum of a record, all fields before check
+static unsigned long maintenanceCheck(const maintenanceRecord &r) {
+    const unsigned long *p = (const unsigned long *)&r;
+    const unsigned long *end = &r.check;
+    unsigned long sum = 0x12345678;
+    for (; p < end; p++) sum = ((sum << 5) | (sum >> 27)) ^ *p;
+    return sum;
+}
+
+/// @brief Constructor, counts from zero until setRecord() loads saved totals
+/// @param itemPtr pointer to array of HvacItems, same as given to hvacLogic
+hvacMaintenance::hvacMaintenance(HvacItem *itemPtr[]) {
+    m_items = *itemPtr;
+    memset(&m_record, 0, sizeof(m_record));
+    m_record.magic = MT_MAGIC;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        m_lastCycles[i] = m_items[i].getCycles();
+        m_lastRun[i] = m_liveRunTime(i);
+    }
+    m_lastWear[0] = m_items[HI_Comp1].getStartWear();
+    m_lastWear[1] = m_items[HI_Comp2].getStartWear();
+    m_lastHard[0] = m_items[HI_Comp1].getHardStarts();
+    m_lastHard[1] = m_items[HI_Comp2].getHardStarts();
+    m_unsaved = 0;
+    m_dirtyTime = 0;
+    m_dirty = false;
+    return;
+}
+
+/// @brief Run time in seconds including the current run
+unsigned long hvacMaintenance::m_liveRunTime(int i) {
+    unsigned long run = m_items[i].getRunTime();
+    if (m_items[i].isOn()) run = run + (timeNow() - m_items[i].getStartTime()) / 1000;
+    return run;
+}
+
+/// @brief Adds wear since the last call, cheap enough to call every Poll
+void hvacMaintenance::Poll() {
+    unsigned long added = 0;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        unsigned long cycles = m_items[i].getCycles();
+        if (cycles != m_lastCycles[i]) {
+            m_record.cycles[i] += cycles - m_lastCycles[i];
+            added += cycles - m_lastCycles[i];
+            m_lastCycles[i] = cycles;
+        }
+        unsigned long run = m_liveRunTime(i);
+        //resetRunTime() by the user starts the item count over
+        unsigned long delta = (run >= m_lastRun[i]) ? run - m_lastRun[i] : run;
+        if (delta > 0) {
+            m_record.runSeconds[i] += delta;
+            if (i == HI_FanLow || i == HI_FanHigh) m_record.filterSeconds += delta;
+            m_lastRun[i] = run;
+            //run time alone, ie: fan left on, is saved by MT_SAVE_INTERVAL
+            if (!m_dirty) m_dirtyTime = timeNow();
+            m_dirty = true;
+        }
+    }
+    hardwareItems comps[2] = {HI_Comp1, HI_Comp2};
+    for (int c = 0; c < 2; c++) {
+        unsigned long wear = m_items[comps[c]].getStartWear();
+        if (wear != m_lastWear[c]) {
+            m_record.compWear[c] += wear - m_lastWear[c];
+            m_lastWear[c] = wear;
+        }
+        unsigned long hard = m_items[comps[c]].getHardStarts();
+        if (hard != m_lastHard[c]) {
+            m_record.hardStarts[c] += hard - m_lastHard[c];
+            m_lastHard[c] = hard;
+        }
+    }
+    if (added > 0) {
+        if (!m_dirty) m_dirtyTime = timeNow();
+        m_dirty = true;
+        m_unsaved += added;
+    }
+    return;
+}
+
+/// @brief Maintenance reminders due now
+/// @return maintenanceDue bits or MD_None
+int hvacMaintenance::getDue() {
+    int due = MD_None;
+    for (int i = 0; i < HI_SizeOf; i++) {
+        if (m_record.cycles[i] - m_record.relayBase[i] >= MT_RELAY_CYCLES) due |= MD_Relay;
+    }
+    for (int c = 0; c < 2; c++) {
+        if (m_record.compWear[c] - m_record.compBase[c] >= MT_COMP_WEAR) due |= MD_Compressor;
+    }
+    if (m_record.filterSeconds >= MT_FILTER_SECONDS) due |= MD_Filter;
+    return due;
+}
+
+/// @brief Record to save, marks it saved
+const maintenanceRecord &hvacMaintenance::getRecord() {
+    m_record.check = maintenanceCheck(m_record);
+    m_unsaved = 0;
+    m_dirty = false;
+    return m_record;
+}
+
+/// @brief Loads saved totals, ie: from EEPROM at boot
+/// @param record previously saved by getRecord()
+/// @return false if record is blank or damaged, totals are unchanged
+bool hvacMaintenance::setRecord(const maintenanceRecord &record) {
+    if (record.magic != MT_MAGIC || record.check != maintenanceCheck(record)) {
+        debuglnI("Maintenance record invalid, starting new");
+        return false;
+    }
+    m_record = record;
+    return true;
+}
+
+bool hvacMaintenance::isSaveDue() {
+    if (!m_dirty) return false;
+    return m_unsaved >= MT_SAVE_CYCLES || (timeNow() - m_dirtyTime) >= MT_SAVE_INTERVAL;
+}
+
+/// @brief Filter cleaned or replaced, restart fan run time
+void hvacMaintenance::serviceFilter() {
+    m_record.filterSeconds = 0;
+    if (!m_dirty) m_dirtyTime = timeNow();
+    m_dirty = true;
+    m_unsaved = MT_SAVE_CYCLES; //save soon
+    return;
+}
+
+/// @brief Relay of an output replaced, restart its cycle count
+/// @param hi hardwareItems enum value ie: HI_Comp1
+void hvacMaintenance::serviceRelay(hardwareItems hi) {
+    m_record.relayBase[hi] = m_record.cycles[hi];
+    if (!m_dirty) m_dirtyTime = timeNow();
+    m_dirty = true;
+    m_unsaved = MT_SAVE_CYCLES;
+    return;
+}
+
+/// @brief Compressor serviced, restart its wear
+/// @param compressor 1 or 2
+void hvacMaintenance::serviceCompressor(int compressor) {
+    if (compressor < 1 || compressor > 2) return;
+    m_record.compBase[compressor - 1] = m_record.compWear[compressor - 1];
+    if (!m_dirty) m_dirtyTime = timeNow();
+    m_dirty = true;
+    m_unsaved = MT_SAVE_CYCLES;
+    return;
+}
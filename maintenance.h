@@ -0,0 +1,80 @@
+/** @file maintenance.h
+ *  @brief Wear accounting and maintenance reminders.
+ *
+ *  Keeps totals that survive power loss: relay cycles of each
+ *  output, compressor starts weighted by how soon they followed a
+ *  stop, run time of each item and fan run time since the last
+ *  filter service. Totals come from the counters of each item,
+ *  the record is small and only needs saving when isSaveDue().
+ *
+ */
+
+
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+#pragma once
+
+#include "hvac.h"
+
+//maintenance thresholds
+
+//Relay rated switching cycles (100000)
+#define MT_RELAY_CYCLES 100000UL
+//Compressor service after this many wear units, MT_START_WEAR per normal start (2000000)
+#define MT_COMP_WEAR 2000000UL
+//Filter service after fan run time in seconds (1800000), 500 hours
+#define MT_FILTER_SECONDS 1800000UL
+//Save record after this many new cycles (50)
+#define MT_SAVE_CYCLES 50
+//or after this much time with unsaved changes in ms (3600000)
+#define MT_SAVE_INTERVAL 3600000UL
+
+//record magic "HVM1"
+#define MT_MAGIC 0x314D5648
+
+/// @brief Maintenance reminders
+enum maintenanceDue {MD_None = 0, MD_Relay = 1, MD_Compressor = 2, MD_Filter = 4};
+
+/// @brief Persisted totals, store as is in EEPROM or flash
+struct maintenanceRecord {
+    unsigned long magic; //MT_MAGIC
+    unsigned long cycles[HI_SizeOf]; //relay cycles of each output
+    unsigned long runSeconds[HI_SizeOf]; //run time of each item
+    unsigned long compWear[2]; //weighted starts of compressor 1 and 2
+    unsigned long hardStarts[2]; //starts within MT_HARD_START of a stop
+    unsigned long filterSeconds; //fan run time since filter service
+    unsigned long relayBase[HI_SizeOf]; //cycles at last relay replacement
+    unsigned long compBase[2]; //wear at last compressor service
+    unsigned long check; //checksum of the fields above
+};
+
+/// @brief Collects wear from the hardware items, call Poll() with hvacLogic::Poll()
+class hvacMaintenance
+{
+public:
+    hvacMaintenance(HvacItem *itemPtr[]);
+    void Poll();
+    int getDue();
+    const maintenanceRecord &getRecord();
+    bool setRecord(const maintenanceRecord &record);
+    /// @brief true when enough changed since the last getRecord() to be worth saving
+    bool isSaveDue();
+    void serviceFilter();
+    void serviceRelay(hardwareItems hi);
+    void serviceCompressor(int compressor);
+
+private:
+    unsigned long m_liveRunTime(int i);
+    HvacItem *m_items;
+    maintenanceRecord m_record;
+    unsigned long m_lastCycles[HI_SizeOf]; //item counters at last Poll
+    unsigned long m_lastRun[HI_SizeOf];
+    unsigned long m_lastWear[2];
+    unsigned long m_lastHard[2];
+    unsigned long m_unsaved; //cycles since last save
+    unsigned long m_dirtyTime; //time of first unsaved change
+    bool m_dirty;
+};
+
+#endif
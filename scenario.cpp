@@ -0,0 +1,139 @@
+/** @file scenario.cpp
+ *  @brief Trip scenarios driving hardware availability for simulation.
+ *
+ */
+
+
+
+#include "scenario.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+
+static const tripLeg tripWeekend[] = {
+    {TS_Shore, 5 * 1440, 12 * 1440}, //at home plugged in
+    {TS_Drive, 60, 240},
+    {TS_Shore, 2 * 1440, 3 * 1440},
+    {TS_Drive, 60, 240}
+};
+
+static const tripLeg tripFullTime[] = {
+    {TS_Drive, 120, 480},
+    {TS_Shore, 3 * 1440, 14 * 1440},
+    {TS_Drive, 120, 480},
+    {TS_Boondock, 1 * 1440, 4 * 1440}
+};
+
+static const tripLeg tripBoondock[] = {
+    {TS_Drive, 60, 300},
+    {TS_Boondock, 2 * 1440, 7 * 1440}
+};
+
+const tripTemplate tripTemplates[] = {
+    {"Weekend", tripWeekend, sizeof(tripWeekend) / sizeof(tripWeekend[0])},
+    {"Full Time", tripFullTime, sizeof(tripFullTime) / sizeof(tripFullTime[0])},
+    {"Boondock", tripBoondock, sizeof(tripBoondock) / sizeof(tripBoondock[0])}
+};
+const int tripTemplateCount = sizeof(tripTemplates) / sizeof(tripTemplates[0]);
+
+/// @brief Adds an event if availability changes
+void scenarioGenerator::s_set(unsigned long time, hardwareItems hi, bool set, std::vector<availEvent> &out) {
+    if (s_avail[hi] == set) return;
+    s_avail[hi] = set;
+    availEvent e;
+    e.time = time;
+    e.item = (unsigned char)hi;
+    e.available = set;
+    out.push_back(e);
+    return;
+}
+
+/// @brief 120V power (shore or generator) feeds compressors and A/C fan
+void scenarioGenerator::s_setPower(unsigned long time, bool set, std::vector<availEvent> &out) {
+    s_set(time, HI_Comp1, set, out);
+    s_set(time, HI_Comp2, set, out);
+    s_set(time, HI_reversingValve, set, out);
+    s_set(time, HI_FanLow, set, out);
+    s_set(time, HI_FanHigh, set, out);
+    return;
+}
+
+/// @brief Engine coolant feeds coach heat
+void scenarioGenerator::s_setEngine(unsigned long time, bool set, std::vector<availEvent> &out) {
+    s_set(time, HI_CoachHeatLow, set, out);
+    s_set(time, HI_CoachHeatHigh, set, out);
+    return;
+}
+
+/// @brief Appends the availability timeline of one coach
+/// @param coach coach number, selects the random stream
+/// @param trip template to follow, legs repeat until days are filled
+/// @param days length of scenario
+/// @param out events appended in time order, all items are set at time 0
+void scenarioGenerator::generate(unsigned long coach, const tripTemplate &trip, unsigned long days, std::vector<availEvent> &out) {
+    scenarioRng rng(s_seed, (unsigned long long)coach * FLEET_STREAMS + STREAM_SCENARIO);
+    unsigned long end = days * 86400UL;
+    out.reserve(out.size() + days * 8);
+
+    //start with everything known, gas is always available
+    for (int i = 0; i < HI_SizeOf; i++) {
+        availEvent e;
+        e.time = 0;
+        e.item = (unsigned char)i;
+        e.available = (i == HI_gasHeat);
+        s_avail[i] = e.available;
+        out.push_back(e);
+    }
+    bool coolingDown = false; //coach heat still warm after a drive
+    unsigned long warmUntil = 0;
+
+    unsigned long t = 0;
+    for (int leg = 0; t < end; leg = (leg + 1) % trip.count) {
+        const tripLeg &l = trip.legs[leg];
+        unsigned long legEnd = t + rng.range(l.minMinutes, l.maxMinutes) * 60UL;
+        if (legEnd > end) legEnd = end;
+
+        //power at start of leg
+        if (l.segment == TS_Drive) {
+            s_setPower(t, rng.range(1, 100) <= SC_GEN_DRIVE_PCT, out);
+        } else {
+            s_setPower(t, l.segment == TS_Shore, out);
+        }
+        //engine, coach heat follows coolant temperature
+        if (l.segment == TS_Drive) {
+            if (!s_avail[HI_CoachHeatLow] && t + SC_WARMUP < legEnd) s_setEngine(t + SC_WARMUP, true, out);
+            coolingDown = true;
+            warmUntil = legEnd + SC_COOLDOWN;
+        } else if (coolingDown) {
+            s_setEngine(warmUntil < legEnd ? warmUntil : legEnd, false, out);
+            coolingDown = false;
+        }
+        //generator runs while boondocking, always starts after cool down
+        if (l.segment == TS_Boondock) {
+            unsigned long g = t + rng.range(SC_GEN_MIN_REST, SC_GEN_MAX_REST);
+            while (g < legEnd) {
+                s_setPower(g, true, out);
+                g = g + rng.range(SC_GEN_MIN_RUN, SC_GEN_MAX_RUN);
+                if (g >= legEnd) break;
+                s_setPower(g, false, out);
+                g = g + rng.range(SC_GEN_MIN_REST, SC_GEN_MAX_REST);
+            }
+        }
+        t = legEnd;
+    }
+    return;
+}
+
+/// @brief Applies all events due by seconds to a controller
+/// @param tstat controller to update
+/// @param events timeline from scenarioGenerator::generate()
+/// @param next index of first event not applied yet, advanced
+/// @param seconds current scenario time
+void scenarioApply(hvacLogic &tstat, const std::vector<availEvent> &events, size_t &next, unsigned long seconds) {
+    while (next < events.size() && events[next].time <= seconds) {
+        tstat.setAvailable((hardwareItems)events[next].item, events[next].available);
+        next++;
+    }
+    return;
+}
+#endif
@@ -0,0 +1,122 @@
+/** @file scenario.h
+ *  @brief Trip scenarios driving hardware availability for simulation.
+ *
+ *  A trip template is a list of legs (driving, campground with
+ *  shore power, boondocking). The generator walks a template with
+ *  a seeded random stream per coach and emits timelines of
+ *  hvacLogic::setAvailable() changes for each hardwareItems entry.
+ *  Same seed and coach always give the same timeline, on any
+ *  thread and in any order.
+ *
+ */
+
+
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <vector>
+
+//scenario parameters in seconds
+
+//engine coolant warm up before coach heat is available (1200)
+#define SC_WARMUP 1200
+//coach heat stays available after engine stops (600)
+#define SC_COOLDOWN 600
+//shortest generator run while boondocking (3600)
+#define SC_GEN_MIN_RUN 3600
+//longest generator run while boondocking (10800)
+#define SC_GEN_MAX_RUN 10800
+//shortest generator rest while boondocking (7200)
+#define SC_GEN_MIN_REST 7200
+//longest generator rest while boondocking (21600)
+#define SC_GEN_MAX_REST 21600
+//percent of drive legs with the generator running for A/C (50)
+#define SC_GEN_DRIVE_PCT 50
+
+//random streams per coach, stream = coach * FLEET_STREAMS + STREAM_...
+#define FLEET_STREAMS 4
+#define STREAM_SCENARIO 0
+#define STREAM_CABIN 1
+
+/// @brief Kind of trip leg
+enum tripSegment {TS_Drive, TS_Shore, TS_Boondock, TS_SizeOf};
+
+/// @brief One leg of a trip, length picked between min and max
+struct tripLeg {
+    tripSegment segment;
+    unsigned short minMinutes;
+    unsigned short maxMinutes;
+};
+
+/// @brief A trip, legs are repeated until the requested days are filled
+struct tripTemplate {
+    const char *name;
+    const tripLeg *legs;
+    int count;
+};
+
+extern const tripTemplate tripTemplates[];
+extern const int tripTemplateCount;
+
+/// @brief One availability change
+struct availEvent {
+    unsigned long time; //seconds from scenario start
+    unsigned char item; //hardwareItems
+    bool available;
+};
+
+/// @brief Counter based random numbers (splitmix64 finalizer over a keyed counter).
+/// Value n of a stream depends only on seed, stream and n, never on thread or call order.
+class scenarioRng
+{
+public:
+    scenarioRng(unsigned long long seed, unsigned long long stream) :
+        r_key(mix(seed ^ mix(stream + 0x9E3779B97F4A7C15ULL))),
+        r_counter(0) {};
+    static unsigned long long mix(unsigned long long z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    };
+    /// @brief value number counter of this stream
+    unsigned long long at(unsigned long long counter) const {
+        return mix(r_key + (counter + 1) * 0x9E3779B97F4A7C15ULL);
+    };
+    unsigned long long next() {return at(r_counter++);};
+    /// @brief uniform value in [lo, hi]
+    unsigned long range(unsigned long lo, unsigned long hi) {
+        if (hi <= lo) return lo;
+        return lo + (unsigned long)(next() % (hi - lo + 1));
+    };
+    unsigned long long getCounter() {return r_counter;};
+    void setCounter(unsigned long long counter) {r_counter = counter;};
+
+private:
+    unsigned long long r_key;
+    unsigned long long r_counter;
+};
+
+/// @brief Builds availability timelines from trip templates
+class scenarioGenerator
+{
+public:
+    scenarioGenerator(unsigned long long seed) : s_seed(seed) {};
+    void generate(unsigned long coach, const tripTemplate &trip, unsigned long days, std::vector<availEvent> &out);
+
+private:
+    void s_set(unsigned long time, hardwareItems hi, bool set, std::vector<availEvent> &out);
+    void s_setPower(unsigned long time, bool set, std::vector<availEvent> &out);
+    void s_setEngine(unsigned long time, bool set, std::vector<availEvent> &out);
+    unsigned long long s_seed;
+    bool s_avail[HI_SizeOf];
+};
+
+void scenarioApply(hvacLogic &tstat, const std::vector<availEvent> &events, size_t &next, unsigned long seconds);
+#endif
+
+#endif
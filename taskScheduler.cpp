@@ -0,0 +1,116 @@
+/** @file taskScheduler.cpp
+ *  @brief Cooperative deadline scheduler for the main loop.
+ *
+ */
+
+
+
+#include "taskScheduler.h"
+#include "JAHdebug.h"
+
+#include <stdio.h>
+
+/// @brief Microseconds for measuring runs, wraps
+static unsigned long schedMicros() {
+    #ifdef PLATFORMIO
+        return micros();
+    #endif
+    #ifdef WIN32
+        return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    #endif
+}
+
+taskScheduler::taskScheduler() {
+    s_count = 0;
+    return;
+}
+
+/// @brief Adds a task, first run is due now
+/// @param name for report()
+/// @param run called when due
+/// @param context given to run
+/// @param period ms between runs, at least 1
+/// @param budget us a run may take before it counts as an overrun
+/// @return task index, -1 if SCHED_MAX_TASKS are in use
+int taskScheduler::add(const char *name, taskFunction run, void *context, unsigned long period, unsigned long budget) {
+    if (s_count >= SCHED_MAX_TASKS) return -1;
+    schedTask &t = s_tasks[s_count];
+    t.name = name;
+    t.run = run;
+    t.context = context;
+    t.period = (period > 0) ? period : 1;
+    t.budget = budget;
+    t.due = timeNow();
+    t.runs = 0;
+    t.late = 0;
+    t.overruns = 0;
+    t.worst = 0;
+    return s_count++;
+}
+
+/// @brief Runs the due task with the earliest deadline, call from loop()
+/// @return false if no task was due, ie: time to idle()
+bool taskScheduler::Poll() {
+    unsigned long now = timeNow();
+    int next = -1;
+    for (int i = 0; i < s_count; i++) {
+        //signed difference so the ms counter may wrap
+        if ((long)(now - s_tasks[i].due) < 0) continue;
+        if (next < 0 || (long)(s_tasks[i].due - s_tasks[next].due) < 0) next = i;
+    }
+    if (next < 0) return false;
+    schedTask &t = s_tasks[next];
+    unsigned long start = schedMicros();
+    t.run(t.context);
+    unsigned long took = schedMicros() - start;
+    t.runs++;
+    if (took > t.worst) t.worst = took;
+    //counted only, report() prints them outside the loop being measured
+    if (took > t.budget) t.overruns++;
+    t.due += t.period;
+    if ((long)(now - t.due) >= 0) {
+        //a whole period behind, skip ahead
+        t.late++;
+        t.due = now + t.period;
+    }
+    return true;
+}
+
+/// @brief Sleeps until the next interrupt, call when Poll() returns false
+void taskScheduler::idle() {
+    #ifdef PLATFORMIO
+        __WFI();
+    #endif
+    #ifdef WIN32
+    #ifndef HVAC_SIM
+        unsigned long now = timeNow();
+        long wait = 0x7FFFFFFF;
+        for (int i = 0; i < s_count; i++) {
+            long left = (long)(s_tasks[i].due - now);
+            if (left < wait) wait = left;
+        }
+        if (wait > 0 && s_count > 0) Sleep((DWORD)wait);
+    #endif
+    #endif
+    return;
+}
+
+/// @brief Total overruns of all tasks
+unsigned long taskScheduler::getOverruns() {
+    unsigned long overruns = 0;
+    for (int i = 0; i < s_count; i++) overruns += s_tasks[i].overruns;
+    return overruns;
+}
+
+/// @brief Prints one line per task: runs, late, overruns, worst run against budget
+void taskScheduler::report() {
+    char line[128];
+    for (int i = 0; i < s_count; i++) {
+        const schedTask &t = s_tasks[i];
+        snprintf(line, sizeof(line), "task %s period %lu runs %lu late %lu overruns %lu worst %lu budget %lu",
+                 t.name, t.period, t.runs, t.late, t.overruns, t.worst, t.budget);
+        debuglnI(line);
+    }
+    return;
+}
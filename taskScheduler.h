@@ -0,0 +1,63 @@
+/** @file taskScheduler.h
+ *  @brief Cooperative deadline scheduler for the main loop.
+ *
+ *  Each task has a period and a budget. Poll() runs the due task
+ *  with the earliest deadline, one per call, so a long task delays
+ *  the others by at most its own run. A task still not run a full
+ *  period after it was due is late, it skips ahead rather than
+ *  running in a burst to catch up. A run longer than its budget is
+ *  an overrun. When nothing is due idle() sleeps the CPU until the
+ *  next interrupt (__WFI, SysTick wakes it every ms).
+ *
+ */
+
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#pragma once
+
+#include "hvac.h"
+
+//tasks per scheduler, fixed so there is no heap on the MCU (8)
+#define SCHED_MAX_TASKS 8
+
+/// @brief Task body, context is given to add()
+typedef void (*taskFunction)(void *context);
+
+/// @brief One task and its counts
+struct schedTask {
+    const char *name;
+    taskFunction run;
+    void *context;
+    unsigned long period; //ms
+    unsigned long budget; //us a run may take
+    unsigned long due; //timeNow() of the next run
+    unsigned long runs;
+    unsigned long late; //runs started a period or more after due
+    unsigned long overruns; //runs longer than budget
+    unsigned long worst; //longest run in us
+};
+
+/// @brief Cooperative scheduler, one per main loop
+class taskScheduler
+{
+public:
+    taskScheduler();
+    int add(const char *name, taskFunction run, void *context, unsigned long period, unsigned long budget);
+    bool Poll();
+    void idle();
+    /// @brief Number of tasks added
+    int getCount() {return s_count;};
+    /// @brief Task counts
+    /// @param task index returned by add()
+    const schedTask &getTask(int task) {return s_tasks[task];};
+    unsigned long getOverruns();
+    void report();
+
+private:
+    schedTask s_tasks[SCHED_MAX_TASKS];
+    int s_count;
+};
+
+#endif
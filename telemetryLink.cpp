@@ -0,0 +1,372 @@
+/** @file telemetryLink.cpp
+ *  @brief Framed serial telemetry from the controller to the host.
+ *
+ */
+
+
+
+#include "telemetryLink.h"
+#include "hvacBench.h"
+#include "JAHdebug.h"
+
+#include <string.h>
+
+#ifdef WIN32
+#include <stdio.h>
+#include <thread>
+#endif
+
+//interrupts off around buffer hand over, txDone() runs in the DMA interrupt
+#ifdef PLATFORMIO
+  #define TL_LOCK() noInterrupts()
+  #define TL_UNLOCK() interrupts()
+#else
+  #define TL_LOCK()
+  #define TL_UNLOCK()
+#endif
+
+//CRC-16 CCITT, polynomial 0x1021, table in flash
+static const unsigned short telemetryCrcTable[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7, 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6, 0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485, 0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4, 0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823, 0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12, 0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41, 0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70, 0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F, 0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E, 0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D, 0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C, 0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB, 0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A, 0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9, 0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8, 0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+/// @brief CRC-16 CCITT, initial 0xFFFF
+unsigned short telemetryCrc(const unsigned char *data, unsigned int length) {
+    unsigned short crc = 0xFFFF;
+    for (unsigned int i = 0; i < length; i++) crc = (unsigned short)((crc << 8) ^ telemetryCrcTable[((crc >> 8) ^ data[i]) & 0xFF]);
+    return crc;
+}
+
+/// @brief COBS encodes, no zero bytes in the output
+/// @param out room for length + length / 254 + 1 bytes
+/// @return bytes written, without delimiter
+unsigned int cobsEncode(const unsigned char *data, unsigned int length, unsigned char *out) {
+    unsigned int code = 0; //where the current block's code goes
+    unsigned int o = 1;
+    unsigned char run = 1;
+    for (unsigned int i = 0; i < length; i++) {
+        if (data[i] == 0) {
+            out[code] = run;
+            code = o++;
+            run = 1;
+            continue;
+        }
+        out[o++] = data[i];
+        if (++run == 0xFF) {
+            out[code] = run;
+            code = o++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    return o;
+}
+
+/// @brief COBS decodes one frame, without delimiter
+/// @param out room for length bytes
+/// @return bytes written, -1 if not valid COBS
+int cobsDecode(const unsigned char *data, unsigned int length, unsigned char *out) {
+    unsigned int i = 0;
+    int o = 0;
+    while (i < length) {
+        unsigned char code = data[i++];
+        if (code == 0 || i + code - 1 > length) return -1;
+        for (unsigned char k = 1; k < code; k++) {
+            if (data[i] == 0) return -1;
+            out[o++] = data[i++];
+        }
+        if (code != 0xFF && i < length) out[o++] = 0;
+    }
+    return o;
+}
+
+static void telemetryPut32(unsigned char *p, unsigned long v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+    return;
+}
+
+static unsigned long telemetryGet32(const unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/// @brief Constructor
+/// @param send starts sending a frame, ie: through DMA
+/// @param context given to send
+telemetryLink::telemetryLink(telemetrySend send, void *context) {
+    l_send = send;
+    l_context = context;
+    l_used = 1; //sequence number goes first
+    l_seq = 0;
+    l_length[0] = 0;
+    l_length[1] = 0;
+    l_sending = -1;
+    l_queued = -1;
+    l_bytes = 0;
+    l_frames = 0;
+    l_dropped = 0;
+    l_cycles = 0;
+    return;
+}
+
+/// @brief Flushes first if a record of size does not fit
+bool telemetryLink::l_room(unsigned int size) {
+    if (l_used + size <= TL_PAYLOAD) return true;
+    flush();
+    return l_used + size <= TL_PAYLOAD;
+}
+
+/// @brief Adds a status snapshot to the packet
+/// @param status from hvacLogic::getStatus()
+/// @param time ms, ie: timeNow()
+/// @return false if it did not fit
+bool telemetryLink::addStatus(const hvacStatus &status, unsigned long time) {
+    if (!l_room(TL_STATUS_SIZE)) return false;
+    unsigned char *p = l_payload + l_used;
+    p[0] = TR_Status;
+    p[1] = (unsigned char)status.mode;
+    p[2] = (unsigned char)status.fanMode;
+    p[3] = (unsigned char)status.goal;
+    p[4] = (unsigned char)(signed char)status.temp;
+    p[5] = (unsigned char)status.heatSetpoint;
+    p[6] = (unsigned char)status.coolSetpoint;
+    p[7] = (unsigned char)status.outputs;
+    p[8] = (unsigned char)(status.outputs >> 8);
+    telemetryPut32(p + 9, (unsigned long)status.timeToComfort);
+    telemetryPut32(p + 13, time);
+    l_used += TL_STATUS_SIZE;
+    return true;
+}
+
+/// @brief Adds an item event to the packet
+/// @param hi item that turned on or off
+/// @param on true if it turned on
+/// @param time ms, ie: timeNow()
+/// @return false if it did not fit
+bool telemetryLink::addEvent(hardwareItems hi, bool on, unsigned long time) {
+    if (!l_room(TL_EVENT_SIZE)) return false;
+    unsigned char *p = l_payload + l_used;
+    p[0] = TR_Event;
+    p[1] = (unsigned char)hi;
+    p[2] = on ? 1 : 0;
+    telemetryPut32(p + 3, time);
+    l_used += TL_EVENT_SIZE;
+    return true;
+}
+
+/// @brief Frames the packet and hands it to send, or queues it behind the frame in flight
+/// @return false if nothing to send or both buffers are in use, the packet is dropped then
+bool telemetryLink::flush() {
+    if (l_used <= 1) return false;
+    unsigned long start = benchCycles();
+    TL_LOCK();
+    int sending = l_sending;
+    bool full = l_queued >= 0;
+    TL_UNLOCK();
+    if (full) {
+        //the sequence number moves on so the host counts the packet lost
+        l_seq++;
+        l_dropped++;
+        l_used = 1;
+        return false;
+    }
+    int b = (sending == 0) ? 1 : 0;
+    l_payload[0] = l_seq++;
+    unsigned short crc = telemetryCrc(l_payload, l_used);
+    l_payload[l_used] = (unsigned char)crc;
+    l_payload[l_used + 1] = (unsigned char)(crc >> 8);
+    unsigned int length = cobsEncode(l_payload, l_used + 2, l_frame[b]);
+    l_frame[b][length++] = 0;
+    l_length[b] = length;
+    l_used = 1;
+    l_cycles += benchCycles() - start;
+    l_bytes += length;
+    l_frames++;
+    TL_LOCK();
+    bool idle = l_sending < 0;
+    if (idle) l_sending = b;
+    else l_queued = b;
+    TL_UNLOCK();
+    if (idle) l_send(l_frame[b], length, l_context);
+    return true;
+}
+
+/// @brief Frame in flight is sent, call from the DMA complete interrupt
+void telemetryLink::txDone() {
+    TL_LOCK();
+    int next = l_queued;
+    l_queued = -1;
+    l_sending = next;
+    TL_UNLOCK();
+    if (next >= 0) l_send(l_frame[next], l_length[next], l_context);
+    return;
+}
+
+/// @brief Constructor
+/// @param onStatus called for each status record, may be NULL
+/// @param onEvent called for each event record, may be NULL
+/// @param context given to the handlers
+telemetryDecoder::telemetryDecoder(telemetryStatusHandler onStatus, telemetryEventHandler onEvent, void *context) {
+    d_onStatus = onStatus;
+    d_onEvent = onEvent;
+    d_context = context;
+    d_used = 0;
+    d_overflow = false;
+    d_synced = false;
+    d_seq = 0;
+    d_badRun = 0;
+    d_bytes = 0;
+    d_frames = 0;
+    d_bad = 0;
+    d_lost = 0;
+    d_records = 0;
+    return;
+}
+
+/// @brief Feeds received bytes, in any pieces
+void telemetryDecoder::feed(const unsigned char *data, unsigned int length) {
+    d_bytes += length;
+    for (unsigned int i = 0; i < length; i++) {
+        if (data[i] != 0) {
+            if (d_used < TL_FRAME) d_buffer[d_used++] = data[i];
+            else d_overflow = true;
+            continue;
+        }
+        if (d_overflow) {
+            d_bad++;
+            d_badRun++;
+        } else if (d_used > 0) d_frame();
+        d_used = 0;
+        d_overflow = false;
+    }
+    return;
+}
+
+/// @brief Checks and hands on the records of one frame
+void telemetryDecoder::d_frame() {
+    unsigned char packet[TL_FRAME];
+    int length = cobsDecode(d_buffer, d_used, packet);
+    if (length < 3 || telemetryCrc(packet, length - 2) != (unsigned short)(packet[length - 2] | (packet[length - 1] << 8))) {
+        d_bad++;
+        d_badRun++;
+        return;
+    }
+    d_frames++;
+    //a bad frame already counted in d_bad is one of the missing sequence numbers, only the rest are lost
+    unsigned char gap = (unsigned char)(packet[0] - d_seq);
+    if (d_synced && gap > d_badRun) d_lost += gap - d_badRun;
+    d_badRun = 0;
+    d_seq = (unsigned char)(packet[0] + 1);
+    d_synced = true;
+    int end = length - 2;
+    int p = 1;
+    while (p < end) {
+        const unsigned char *r = packet + p;
+        if (r[0] == TR_Status && p + TL_STATUS_SIZE <= end) {
+            hvacStatus status;
+            status.mode = (hvacMode)r[1];
+            status.fanMode = (hvacFanMode)r[2];
+            status.goal = (hardwareMode)r[3];
+            status.temp = (signed char)r[4];
+            status.heatSetpoint = r[5];
+            status.coolSetpoint = r[6];
+            status.outputs = r[7] | (r[8] << 8);
+            status.timeToComfort = (long)telemetryGet32(r + 9);
+            status.generation = 0; //not sent, every record is a full snapshot
+            status.changed = SF_ALL;
+            if (d_onStatus != NULL) d_onStatus(status, telemetryGet32(r + 13), d_context);
+            p += TL_STATUS_SIZE;
+        } else if (r[0] == TR_Event && p + TL_EVENT_SIZE <= end) {
+            if (d_onEvent != NULL) d_onEvent((hardwareItems)r[1], r[2] != 0, telemetryGet32(r + 3), d_context);
+            p += TL_EVENT_SIZE;
+        } else {
+            //unknown record, the rest of the packet can not be parsed
+            d_bad++;
+            return;
+        }
+        d_records++;
+    }
+    return;
+}
+
+#ifdef WIN32
+/// @brief Pipe carrying frames to the reader, stands in for DMA and UART
+struct telemetryPipe {
+    HANDLE write;
+    telemetryLink *link;
+};
+
+static void telemetryPipeSend(const unsigned char *frame, unsigned int length, void *context) {
+    telemetryPipe *pipe = (telemetryPipe *)context;
+    DWORD put = 0;
+    WriteFile(pipe->write, frame, length, &put, NULL);
+    //the write is done by the time it returns, complete like a DMA interrupt would
+    pipe->link->txDone();
+    return;
+}
+
+static void telemetryCountStatus(const hvacStatus &status, unsigned long time, void *context) {
+    (*(unsigned long *)context)++;
+    return;
+}
+
+/// @brief Sends records through a pipe and decodes them on a second thread, no hardware needed
+/// @param records status snapshots and events to send
+/// @param report bytes per record, encode cycles per byte and decode results
+/// @return true if everything sent arrived intact and in order
+bool telemetryLoopback(unsigned long records, std::string &report) {
+    HANDLE readEnd, writeEnd;
+    if (!CreatePipe(&readEnd, &writeEnd, NULL, 0)) return false;
+    unsigned long statuses = 0;
+    telemetryDecoder decoder(telemetryCountStatus, NULL, &statuses);
+    std::thread reader([&]() {
+        unsigned char buffer[4096];
+        DWORD got = 0;
+        while (ReadFile(readEnd, buffer, sizeof(buffer), &got, NULL) && got > 0) decoder.feed(buffer, got);
+    });
+    telemetryPipe pipe;
+    pipe.write = writeEnd;
+    telemetryLink link(telemetryPipeSend, &pipe);
+    pipe.link = &link;
+    hvacStatus status = {M_Cool, FM_Auto, HM_LowCool, 75, 70, 73, 0, 0};
+    unsigned long sent = 0;
+    for (unsigned long i = 0; i < records; i++) {
+        if (i % 4 == 0) {
+            status.temp = 70 + (int)(i % 9);
+            status.outputs = (unsigned int)(i & 0x66);
+            link.addStatus(status, i * 100);
+            sent++;
+        } else {
+            link.addEvent((hardwareItems)(i % HI_SizeOf), (i & 1) != 0, i * 100);
+        }
+    }
+    link.flush();
+    CloseHandle(writeEnd);
+    reader.join();
+    CloseHandle(readEnd);
+    char line[256];
+    snprintf(line, sizeof(line), "records %lu bytes %lu (%.2f per record) frames %lu encode %.2f cycles per byte decoded %lu bad %lu lost %lu",
+             records, link.getBytes(), (double)link.getBytes() / records, link.getFrames(),
+             (double)link.getEncodeCycles() / link.getBytes(), decoder.getRecords(), decoder.getBad(), decoder.getLost());
+    report = line;
+    return decoder.getRecords() == records && statuses == sent && decoder.getBad() == 0 && decoder.getLost() == 0 &&
+           link.getDropped() == 0;
+}
+#endif
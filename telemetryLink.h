@@ -0,0 +1,128 @@
+/** @file telemetryLink.h
+ *  @brief Framed serial telemetry from the controller to the host.
+ *
+ *  The MCU batches status snapshots and item events into a packet,
+ *  appends a CRC-16 (CCITT) and COBS encodes it, so a frame holds no
+ *  zero byte and a single 0x00 ends it. A frame is encoded once into
+ *  one of two buffers and handed whole to the send function, ie:
+ *  HAL_UART_Transmit_DMA(), the CPU does not feed the UART a byte at
+ *  a time. While one buffer is in flight the next is filled; call
+ *  txDone() from the DMA complete interrupt.
+ *
+ *  telemetryDecoder on the host splits the byte stream at zeros,
+ *  checks the CRC and a sequence number and hands each record to
+ *  the daemon. A bad or lost frame costs only that frame, the next
+ *  zero resynchronizes.
+ *
+ *  Packet: seq, then records. Status record (TR_Status, 17 bytes):
+ *  type, mode, fanMode, goal, temp, heatSetpoint, coolSetpoint,
+ *  outputs (2), timeToComfort (4), time ms (4), all little endian.
+ *  Event record (TR_Event, 7 bytes): type, item, on, time ms (4).
+ *
+ */
+
+
+#ifndef TELEMETRYLINK_H
+#define TELEMETRYLINK_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <string>
+#endif
+
+//payload bytes per packet before CRC, flushes when the next record does not fit (240)
+#define TL_PAYLOAD 240
+//encoded frame: payload, CRC, COBS overhead and the 0x00 delimiter
+#define TL_FRAME (TL_PAYLOAD + 2 + (TL_PAYLOAD + 2) / 254 + 1 + 1)
+#define TL_STATUS_SIZE 17
+#define TL_EVENT_SIZE 7
+
+/// @brief Record types in a packet
+enum telemetryRecord {TR_Status = 1, TR_Event = 2};
+
+/// @brief Starts sending a frame, ie: HAL_UART_Transmit_DMA(), must not wait for it to finish
+typedef void (*telemetrySend)(const unsigned char *frame, unsigned int length, void *context);
+
+unsigned short telemetryCrc(const unsigned char *data, unsigned int length);
+unsigned int cobsEncode(const unsigned char *data, unsigned int length, unsigned char *out);
+int cobsDecode(const unsigned char *data, unsigned int length, unsigned char *out);
+
+/// @brief MCU side, batches records into frames and hands them to DMA
+class telemetryLink
+{
+public:
+    telemetryLink(telemetrySend send, void *context);
+    bool addStatus(const hvacStatus &status, unsigned long time);
+    bool addEvent(hardwareItems hi, bool on, unsigned long time);
+    bool flush();
+    void txDone();
+    /// @brief Encoded bytes handed to send, including delimiters
+    unsigned long getBytes() {return l_bytes;};
+    unsigned long getFrames() {return l_frames;};
+    /// @brief Frames dropped because both buffers were in use
+    unsigned long getDropped() {return l_dropped;};
+    /// @brief Cycles spent in flush() for CRC and COBS, see hvacBench.h benchCycles()
+    unsigned long long getEncodeCycles() {return l_cycles;};
+
+private:
+    bool l_room(unsigned int size);
+    telemetrySend l_send;
+    void *l_context;
+    unsigned char l_payload[TL_PAYLOAD + 2]; //room for the CRC
+    unsigned int l_used;
+    unsigned char l_seq;
+    unsigned char l_frame[2][TL_FRAME];
+    unsigned int l_length[2];
+    volatile int l_sending; //buffer in flight, -1 if none
+    volatile int l_queued; //buffer waiting for the one in flight, -1 if none
+    unsigned long l_bytes;
+    unsigned long l_frames;
+    unsigned long l_dropped;
+    unsigned long long l_cycles;
+};
+
+/// @brief Status record as decoded
+typedef void (*telemetryStatusHandler)(const hvacStatus &status, unsigned long time, void *context);
+/// @brief Event record as decoded
+typedef void (*telemetryEventHandler)(hardwareItems hi, bool on, unsigned long time, void *context);
+
+/// @brief Host side, decodes the byte stream of a telemetryLink
+class telemetryDecoder
+{
+public:
+    telemetryDecoder(telemetryStatusHandler onStatus, telemetryEventHandler onEvent, void *context);
+    void feed(const unsigned char *data, unsigned int length);
+    unsigned long getBytes() {return d_bytes;};
+    unsigned long getFrames() {return d_frames;};
+    /// @brief Frames with a bad CRC, bad COBS or too long
+    unsigned long getBad() {return d_bad;};
+    /// @brief Frames missing by sequence number, not counting the bad frames that filled the gap
+    unsigned long getLost() {return d_lost;};
+    unsigned long getRecords() {return d_records;};
+
+private:
+    void d_frame();
+    telemetryStatusHandler d_onStatus;
+    telemetryEventHandler d_onEvent;
+    void *d_context;
+    unsigned char d_buffer[TL_FRAME];
+    unsigned int d_used;
+    bool d_overflow;
+    bool d_synced; //a sequence number was seen
+    unsigned char d_seq; //next expected
+    unsigned long d_badRun; //bad frames since the last good one, they account for part of a gap
+    unsigned long d_bytes;
+    unsigned long d_frames;
+    unsigned long d_bad;
+    unsigned long d_lost;
+    unsigned long d_records;
+};
+
+#ifdef WIN32
+bool telemetryLoopback(unsigned long records, std::string &report);
+#endif
+
+#endif
@@ -0,0 +1,348 @@
+/** @file telemetryPack.cpp
+ *  @brief Compresses the status stream into blocks for upload.
+ *
+ */
+
+
+
+#include "telemetryPack.h"
+#include "telemetryLink.h"
+#include "JAHdebug.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#ifdef WIN32
+#include <vector>
+#include "journal.h"
+#endif
+
+static_assert(HI_SizeOf <= 8, "packRecord outputs holds 8 items");
+
+//escape code of a delta that does not fit TP_DELTA_BITS
+#define TP_ESCAPE ((1u << TP_DELTA_BITS) - 1)
+
+/// @brief Appends bits to a block, low bit first
+struct packWriter {
+    unsigned char *data;
+    unsigned int bits;
+    void put(unsigned long value, unsigned int count) {
+        for (unsigned int i = 0; i < count; i++, bits++) {
+            if ((bits & 7) == 0) data[bits >> 3] = 0;
+            if ((value >> i) & 1) data[bits >> 3] |= (unsigned char)(1 << (bits & 7));
+        }
+    };
+    void putDelta(int from, int to) {
+        int d = to - from;
+        unsigned long z = (d < 0) ? ((unsigned long)(-(long)d) << 1) - 1 : (unsigned long)d << 1;
+        if (z < TP_ESCAPE) {
+            put(z, TP_DELTA_BITS);
+        } else {
+            put(TP_ESCAPE, TP_DELTA_BITS);
+            put((unsigned short)(short)to, 16);
+        }
+    };
+};
+
+/// @brief Reads bits of a block, stops at its end
+struct packReader {
+    const unsigned char *data;
+    unsigned int bits;
+    unsigned int length; //bits
+    bool bad;
+    unsigned long get(unsigned int count) {
+        unsigned long value = 0;
+        if (bits + count > length) {
+            bad = true;
+            return 0;
+        }
+        for (unsigned int i = 0; i < count; i++, bits++) {
+            if ((data[bits >> 3] >> (bits & 7)) & 1) value |= 1ul << i;
+        }
+        return value;
+    };
+    int getDelta(int from) {
+        unsigned long z = get(TP_DELTA_BITS);
+        if (z == TP_ESCAPE) return (short)get(16);
+        return (z & 1) ? from - (int)((z + 1) >> 1) : from + (int)(z >> 1);
+    };
+};
+
+telemetryPacker::telemetryPacker(packOutput out, void *context) {
+    p_out = out;
+    p_context = context;
+    p_count = 0;
+    p_haveLast = false;
+    memset(&p_last, 0, sizeof(p_last));
+    p_snapshots = 0;
+    p_changes = 0;
+    p_blocks = 0;
+    p_bytes = 0;
+    return;
+}
+
+/// @brief Keeps a snapshot if it changed, packs a block when TP_RECORDS are held
+/// @param status from hvacLogic::getStatus()
+/// @param time ms, ie: timeNow()
+/// @return true if kept as a change
+bool telemetryPacker::add(const hvacStatus &status, unsigned long time) {
+    p_snapshots++;
+    packRecord r;
+    r.time = time;
+    r.temp = (short)status.temp;
+    r.heatSetpoint = (unsigned char)status.heatSetpoint;
+    r.coolSetpoint = (unsigned char)status.coolSetpoint;
+    r.mode = (unsigned char)status.mode;
+    r.fanMode = (unsigned char)status.fanMode;
+    r.goal = (unsigned char)status.goal;
+    r.outputs = (unsigned char)status.outputs;
+    if (p_haveLast && r.temp == p_last.temp && r.heatSetpoint == p_last.heatSetpoint &&
+        r.coolSetpoint == p_last.coolSetpoint && r.mode == p_last.mode && r.fanMode == p_last.fanMode &&
+        r.goal == p_last.goal && r.outputs == p_last.outputs) return false;
+    p_last = r;
+    p_haveLast = true;
+    p_records[p_count++] = r;
+    p_changes++;
+    if (p_count == TP_RECORDS) flush();
+    return true;
+}
+
+/// @brief Packs the changes held into a block and hands it to out, ie: before an upload
+void telemetryPacker::flush() {
+    if (p_count == 0) return;
+    packWriter w;
+    w.data = p_block;
+    w.bits = 0;
+    const packRecord &first = p_records[0];
+    w.put(p_count, 8);
+    w.put(first.time, 32);
+    w.put(first.mode, 3);
+    w.put(first.fanMode, 2);
+    w.put(first.goal, 4);
+    w.put((unsigned short)first.temp, 16);
+    w.put(first.heatSetpoint, 16);
+    w.put(first.coolSetpoint, 16);
+    w.put(first.outputs, HI_SizeOf);
+    //time
+    for (unsigned int i = 1; i < p_count; i++) {
+        unsigned long d = p_records[i].time - p_records[i - 1].time;
+        if (d < (1ul << 12)) {
+            w.put(0, 2);
+            w.put(d, 12);
+        } else if (d < (1ul << 16)) {
+            w.put(1, 2);
+            w.put(d, 16);
+        } else if (d < (1ul << 24)) {
+            w.put(2, 2);
+            w.put(d, 24);
+        } else {
+            w.put(3, 2);
+            w.put(d, 32);
+        }
+    }
+    //temp
+    for (unsigned int i = 1; i < p_count; i++) w.putDelta(p_records[i - 1].temp, p_records[i].temp);
+    //setpoints
+    for (unsigned int i = 1; i < p_count; i++) {
+        const packRecord &a = p_records[i - 1];
+        const packRecord &b = p_records[i];
+        bool changed = a.heatSetpoint != b.heatSetpoint || a.coolSetpoint != b.coolSetpoint;
+        w.put(changed ? 1 : 0, 1);
+        if (!changed) continue;
+        w.putDelta(a.heatSetpoint, b.heatSetpoint);
+        w.putDelta(a.coolSetpoint, b.coolSetpoint);
+    }
+    //modes
+    for (unsigned int i = 1; i < p_count; i++) {
+        bool changed = p_records[i - 1].mode != p_records[i].mode || p_records[i - 1].fanMode != p_records[i].fanMode;
+        w.put(changed ? 1 : 0, 1);
+        if (!changed) continue;
+        w.put(p_records[i].mode, 3);
+        w.put(p_records[i].fanMode, 2);
+    }
+    //goal runs
+    for (unsigned int i = 1; i < p_count;) {
+        unsigned int run = 1;
+        while (i + run < p_count && p_records[i + run].goal == p_records[i].goal) run++;
+        w.put(p_records[i].goal, 4);
+        w.put(run - 1, TP_RUN_BITS);
+        i += run;
+    }
+    //outputs
+    for (unsigned int i = 1; i < p_count; i++) {
+        bool changed = p_records[i - 1].outputs != p_records[i].outputs;
+        w.put(changed ? 1 : 0, 1);
+        if (changed) w.put(p_records[i].outputs, HI_SizeOf);
+    }
+    unsigned int length = (w.bits + 7) / 8;
+    p_out(p_block, length, p_context);
+    p_blocks++;
+    p_bytes += length;
+    p_count = 0;
+    return;
+}
+
+unsigned long telemetryPacker::getRawBytes() {
+    return p_snapshots * TL_STATUS_SIZE;
+}
+
+unsigned long telemetryPacker::getRatio() {
+    if (p_bytes == 0) return 0;
+    return (unsigned long)((unsigned long long)getRawBytes() * 100 / p_bytes);
+}
+
+/// @brief Prints snapshots, changes, packed and raw bytes and the ratios against all snapshots and against the changes alone
+void telemetryPacker::report() {
+    char line[192];
+    unsigned long ratio = getRatio();
+    unsigned long changes = (p_bytes == 0) ? 0 :
+        (unsigned long)((unsigned long long)p_changes * TL_STATUS_SIZE * 100 / p_bytes);
+    snprintf(line, sizeof(line), "pack snapshots %lu changes %lu blocks %lu bytes %lu raw %lu ratio %lu.%02lu changes ratio %lu.%02lu ram %u",
+             p_snapshots, p_changes, p_blocks, p_bytes, getRawBytes(), ratio / 100, ratio % 100,
+             changes / 100, changes % 100, getRam());
+    debuglnI(line);
+    return;
+}
+
+int telemetryUnpack(const unsigned char *block, unsigned int length, packStatusHandler onStatus, void *context) {
+    packReader rd;
+    rd.data = block;
+    rd.bits = 0;
+    rd.length = length * 8;
+    rd.bad = false;
+    unsigned int count = (unsigned int)rd.get(8);
+    if (count == 0 || count > TP_RECORDS) return -1;
+    packRecord r[TP_RECORDS];
+    r[0].time = rd.get(32);
+    r[0].mode = (unsigned char)rd.get(3);
+    r[0].fanMode = (unsigned char)rd.get(2);
+    r[0].goal = (unsigned char)rd.get(4);
+    r[0].temp = (short)rd.get(16);
+    r[0].heatSetpoint = (unsigned char)rd.get(16);
+    r[0].coolSetpoint = (unsigned char)rd.get(16);
+    r[0].outputs = (unsigned char)rd.get(HI_SizeOf);
+    static const unsigned int timeBits[4] = {12, 16, 24, 32};
+    //unchanged fields carry over column by column
+    for (unsigned int i = 1; i < count; i++) {
+        r[i].time = r[i - 1].time + rd.get(timeBits[rd.get(2)]);
+    }
+    for (unsigned int i = 1; i < count; i++) r[i].temp = (short)rd.getDelta(r[i - 1].temp);
+    for (unsigned int i = 1; i < count; i++) {
+        r[i].heatSetpoint = r[i - 1].heatSetpoint;
+        r[i].coolSetpoint = r[i - 1].coolSetpoint;
+        if (rd.get(1) == 0) continue;
+        r[i].heatSetpoint = (unsigned char)rd.getDelta(r[i - 1].heatSetpoint);
+        r[i].coolSetpoint = (unsigned char)rd.getDelta(r[i - 1].coolSetpoint);
+    }
+    for (unsigned int i = 1; i < count; i++) {
+        r[i].mode = r[i - 1].mode;
+        r[i].fanMode = r[i - 1].fanMode;
+        if (rd.get(1) == 0) continue;
+        r[i].mode = (unsigned char)rd.get(3);
+        r[i].fanMode = (unsigned char)rd.get(2);
+    }
+    for (unsigned int i = 1; i < count && !rd.bad;) {
+        unsigned char goal = (unsigned char)rd.get(4);
+        unsigned int run = (unsigned int)rd.get(TP_RUN_BITS) + 1;
+        if (i + run > count) return -1;
+        for (; run > 0; run--) r[i++].goal = goal;
+    }
+    for (unsigned int i = 1; i < count; i++) {
+        r[i].outputs = (rd.get(1) != 0) ? (unsigned char)rd.get(HI_SizeOf) : r[i - 1].outputs;
+    }
+    if (rd.bad) return -1;
+    for (unsigned int i = 0; i < count; i++) {
+        if (r[i].mode >= M_SizeOf || r[i].fanMode >= FM_SizeOf || r[i].goal >= HM_SizeOf) return -1;
+        hvacStatus status;
+        status.mode = (hvacMode)r[i].mode;
+        status.fanMode = (hvacFanMode)r[i].fanMode;
+        status.goal = (hardwareMode)r[i].goal;
+        status.temp = r[i].temp;
+        status.heatSetpoint = r[i].heatSetpoint;
+        status.coolSetpoint = r[i].coolSetpoint;
+        status.outputs = r[i].outputs;
+        status.timeToComfort = TTC_UNKNOWN;
+        status.generation = 0; //not sent, every record is a full snapshot
+        status.changed = SF_ALL;
+        onStatus(status, r[i].time, context);
+    }
+    return (int)count;
+}
+
+#ifdef WIN32
+/// @brief Blocks of one packer and the records they should unpack to
+struct packCheck {
+    std::vector<std::vector<unsigned char> > blocks;
+    std::vector<hvacStatus> expected;
+    std::vector<unsigned long> times;
+    size_t next;
+    bool same;
+};
+
+static void packCheckBlock(const unsigned char *block, unsigned int length, void *context) {
+    ((packCheck *)context)->blocks.push_back(std::vector<unsigned char>(block, block + length));
+    return;
+}
+
+static void packCheckStatus(const hvacStatus &status, unsigned long time, void *context) {
+    packCheck *c = (packCheck *)context;
+    if (c->next >= c->expected.size()) {
+        c->same = false;
+        return;
+    }
+    const hvacStatus &e = c->expected[c->next];
+    if (time != c->times[c->next] || status.mode != e.mode || status.fanMode != e.fanMode || status.goal != e.goal ||
+        status.temp != e.temp || status.heatSetpoint != e.heatSetpoint || status.coolSetpoint != e.coolSetpoint ||
+        status.outputs != e.outputs) c->same = false;
+    c->next++;
+    return;
+}
+
+/// @brief Packs every record of a journal, unpacks the blocks again and compares
+/// @param path journal written by hvacJournal
+/// @param report line from telemetryPacker::report() values
+/// @return true if every record came back the same
+bool telemetryPackJournal(const std::string &path, std::string &report) {
+    journalReader reader;
+    if (!reader.open(path)) return false;
+    std::vector<journalRecord> records;
+    reader.find(0, 0x7FFFFFFFFFFFFFFFLL, 0, 0, records);
+    packCheck check;
+    check.next = 0;
+    check.same = true;
+    telemetryPacker packer(packCheckBlock, &check);
+    for (size_t i = 0; i < records.size(); i++) {
+        const journalRecord &r = records[i];
+        hvacStatus status;
+        status.mode = (hvacMode)r.mode;
+        status.fanMode = (hvacFanMode)r.fanMode;
+        status.goal = (hardwareMode)r.goal;
+        status.temp = r.temp;
+        status.heatSetpoint = r.heatSetpoint;
+        status.coolSetpoint = r.coolSetpoint;
+        status.outputs = r.outputs;
+        status.timeToComfort = r.timeToComfort;
+        status.generation = 0; //not in the journal
+        status.changed = SF_ALL;
+        //blocks carry 32 bit ms like timeNow()
+        unsigned long time = (unsigned long)(r.time & 0xFFFFFFFF);
+        if (packer.add(status, time)) {
+            check.expected.push_back(status);
+            check.times.push_back(time);
+        }
+    }
+    packer.flush();
+    for (size_t i = 0; i < check.blocks.size(); i++) {
+        if (telemetryUnpack(check.blocks[i].data(), (unsigned int)check.blocks[i].size(), packCheckStatus, &check) < 0) check.same = false;
+    }
+    if (check.next != check.expected.size()) check.same = false;
+    char line[192];
+    unsigned long ratio = packer.getRatio();
+    snprintf(line, sizeof(line), "snapshots %lu changes %lu blocks %lu bytes %lu raw %lu ratio %lu.%02lu (%.2f bytes per change) unpacked %s",
+             packer.getSnapshots(), packer.getChanges(), packer.getBlocks(), packer.getBytes(), packer.getRawBytes(),
+             ratio / 100, ratio % 100, packer.getChanges() ? (double)packer.getBytes() / packer.getChanges() : 0.0,
+             check.same ? "same" : "DIFFERENT");
+    report = line;
+    return check.same;
+}
+#endif
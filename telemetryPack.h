@@ -0,0 +1,121 @@
+/** @file telemetryPack.h
+ *  @brief Compresses the status stream into blocks for upload.
+ *
+ *  Cellular data in remote campgrounds is paid by the byte. add()
+ *  keeps a status snapshot only when something other than
+ *  timeToComfort changed (it moves every Poll and the cloud can work
+ *  it out again from temp and setpoints), up to TP_RECORDS changes.
+ *  flush() then packs them column by column into one block:
+ *
+ *  Header: count (8 bits), time ms (32), then the first record in
+ *  full: mode (3), fanMode (2), goal (4), temp, heatSetpoint,
+ *  coolSetpoint (16 each) and outputs (HI_SizeOf bits).
+ *  Columns for the records after it, in this order:
+ *  - time: 2 bit size then the ms since the previous record in 12,
+ *    16, 24 or 32 bits.
+ *  - temp: delta from the previous record, zigzag in TP_DELTA_BITS,
+ *    all ones followed by the temp in 16 bits if it does not fit.
+ *  - setpoints: 1 bit changed, then heat and cool deltas as temp.
+ *  - modes: 1 bit changed, then mode and fanMode.
+ *  - goal: run length, goal (4) and records in the run less one
+ *    (TP_RUN_BITS) until every record is covered.
+ *  - outputs: 1 bit changed, then the outputs bit packed.
+ *  Bits are written from the low bit of each byte up.
+ *
+ *  RAM is fixed: TP_RECORDS raw records and one TP_BLOCK_MAX block,
+ *  see getRam(). Nothing is allocated.
+ *
+ */
+
+
+#ifndef TELEMETRYPACK_H
+#define TELEMETRYPACK_H
+
+#pragma once
+
+#include "hvac.h"
+
+#ifdef WIN32
+#include <string>
+#endif
+
+//changes per block, more packs better but each costs a packRecord of RAM, 12 bytes on the MCU (32)
+#define TP_RECORDS 32
+//bits of a zigzag temp or setpoint delta, larger steps escape to 16 bits (3)
+#define TP_DELTA_BITS 3
+//bits of a goal run length, must hold TP_RECORDS - 1
+#define TP_RUN_BITS 5
+#define TP_HEADER_BITS (8 + 32 + 3 + 2 + 4 + 16 * 3 + HI_SizeOf)
+#define TP_RECORD_BITS (34 + (TP_DELTA_BITS + 16) * 3 + 1 + 1 + 5 + 4 + TP_RUN_BITS + 1 + HI_SizeOf)
+//largest block flush() can write
+#define TP_BLOCK_MAX ((TP_HEADER_BITS + TP_RECORD_BITS * (TP_RECORDS - 1) + 7) / 8)
+
+static_assert(TP_RECORDS <= 255 && (TP_RECORDS - 1) < (1 << TP_RUN_BITS), "TP_RUN_BITS too small for TP_RECORDS");
+
+/// @brief Takes a packed block, ie: queues it for upload
+typedef void (*packOutput)(const unsigned char *block, unsigned int length, void *context);
+/// @brief Status unpacked from a block, timeToComfort is TTC_UNKNOWN
+typedef void (*packStatusHandler)(const hvacStatus &status, unsigned long time, void *context);
+
+/// @brief Status as held until the block is packed
+struct packRecord {
+    unsigned long time; //ms
+    short temp; //*F
+    unsigned char heatSetpoint; //*F
+    unsigned char coolSetpoint; //*F
+    unsigned char mode; //hvacMode
+    unsigned char fanMode; //hvacFanMode
+    unsigned char goal; //hardwareMode
+    unsigned char outputs; //output bitmask
+};
+
+/// @brief Packs status changes into blocks
+class telemetryPacker
+{
+public:
+    telemetryPacker(packOutput out, void *context);
+    bool add(const hvacStatus &status, unsigned long time);
+    void flush();
+    /// @brief Snapshots given to add()
+    unsigned long getSnapshots() {return p_snapshots;};
+    /// @brief Snapshots kept as changes
+    unsigned long getChanges() {return p_changes;};
+    unsigned long getBlocks() {return p_blocks;};
+    /// @brief Packed bytes handed to out
+    unsigned long getBytes() {return p_bytes;};
+    /// @brief Bytes the snapshots take as telemetryLink status records
+    unsigned long getRawBytes();
+    /// @brief Compression of all snapshots, raw / packed
+    /// @return ratio * 100
+    unsigned long getRatio();
+    /// @brief RAM of the packer, fixed
+    unsigned int getRam() {return sizeof(telemetryPacker);};
+    void report();
+
+private:
+    packOutput p_out;
+    void *p_context;
+    packRecord p_records[TP_RECORDS];
+    unsigned int p_count;
+    bool p_haveLast;
+    packRecord p_last; //last change kept, for the next add()
+    unsigned char p_block[TP_BLOCK_MAX];
+    unsigned long p_snapshots;
+    unsigned long p_changes;
+    unsigned long p_blocks;
+    unsigned long p_bytes;
+};
+
+/// @brief Unpacks blocks, ie: in the upload service
+/// @param block as handed to packOutput
+/// @param length bytes
+/// @param onStatus called for each record in order
+/// @param context given to onStatus
+/// @return records unpacked, -1 if the block is cut short or malformed
+int telemetryUnpack(const unsigned char *block, unsigned int length, packStatusHandler onStatus, void *context);
+
+#ifdef WIN32
+bool telemetryPackJournal(const std::string &path, std::string &report);
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/** @file tempEstimator.cpp
+ *  @brief Kalman filtered cabin temperature with a short look ahead.
+ *
+ */
+
+
+
+#include "tempEstimator.h"
+#include "JAHdebug.h"
+
+//ms per hour, rates are per hour
+#define KF_HOUR 3600000LL
+
+tempEstimator::tempEstimator() {
+    e_lead = KF_LEAD;
+    reset();
+    return;
+}
+
+/// @brief Forgets the estimate, the next reading starts over
+void tempEstimator::reset() {
+    e_valid = false;
+    e_time = 0;
+    e_temp = 0;
+    e_drift = 0;
+    e_input = 0;
+    e_p00 = KF_SENSOR;
+    e_p01 = 0;
+    e_p11 = KF_START_RATE;
+    return;
+}
+
+/// @brief Predicts to now with the outputs that were running, then corrects with the reading
+/// @param temp reading *F
+/// @param inputRate modeled rate of the outputs running from now on, 1/100 *F per hour
+/// @param now ms, ie: timeNow()
+void tempEstimator::update(int temp, long inputRate, unsigned long now) {
+    long long z = (long long)temp * KF_ONE;
+    if (!e_valid) {
+        reset();
+        e_valid = true;
+        e_temp = (long)z;
+        e_time = now;
+        e_input = (long)(((long long)inputRate * KF_ONE) / 100);
+        return;
+    }
+    long long dt = (long long)(now - e_time);
+    if (dt > (long long)KF_MAX_STEP) dt = KF_MAX_STEP;
+    e_time = now;
+    //predict: T += (b + u) dt, P = F P F' + Q with F = [1 dt; 0 1]
+    e_temp += (long)(((long long)(e_drift + e_input) * dt) / KF_HOUR);
+    long long p01dt = ((long long)e_p01 * dt) / KF_HOUR;
+    long long p11dt = ((long long)e_p11 * dt) / KF_HOUR;
+    e_p00 += (long)(2 * p01dt + (p11dt * dt) / KF_HOUR + ((long long)KF_NOISE_TEMP * dt) / KF_HOUR);
+    e_p01 += (long)p11dt;
+    e_p11 += (long)(((long long)KF_NOISE_RATE * dt) / KF_HOUR);
+    //correct: K = P H' / (H P H' + R) with H = [1 0]
+    long long s = (long long)e_p00 + KF_SENSOR;
+    long long k0 = ((long long)e_p00 * KF_ONE) / s; //1/65536
+    long long k1 = ((long long)e_p01 * KF_ONE) / s; //1/65536 per hour
+    long long y = z - e_temp;
+    e_temp += (long)((k0 * y) / KF_ONE);
+    e_drift += (long)((k1 * y) / KF_ONE);
+    long p00 = e_p00;
+    long p01 = e_p01;
+    e_p00 = (long)(p00 - (k0 * p00) / KF_ONE);
+    e_p01 = (long)(p01 - (k0 * p01) / KF_ONE);
+    e_p11 = (long)(e_p11 - (k1 * p01) / KF_ONE);
+    e_input = (long)(((long long)inputRate * KF_ONE) / 100);
+    return;
+}
+
+/// @brief Temperature getLead() ms from now, carried on from the last reading
+/// @param now ms, ie: timeNow()
+/// @param inputRate modeled rate of the outputs running now, 1/100 *F per hour
+/// @return *F
+int tempEstimator::getPredicted(unsigned long now, long inputRate) {
+    long long since = (long long)(now - e_time);
+    if (since > (long long)KF_MAX_STEP) since = KF_MAX_STEP;
+    long long input = ((long long)inputRate * KF_ONE) / 100;
+    long long ahead = ((e_drift + input) * (since + (long long)e_lead)) / KF_HOUR;
+    return e_round((long)(e_temp + ahead));
+}
@@ -0,0 +1,89 @@
+/** @file tempEstimator.h
+ *  @brief Kalman filtered cabin temperature with a short look ahead.
+ *
+ *  State is the temperature T and the drift b, the rate the cabin
+ *  moves on its own (sun, outdoor air, people). Between readings
+ *  T moves by (b + u) dt, with u the modeled rate of the outputs
+ *  that are running (hvacLogic::setItemRate()), b is a random walk.
+ *  Each whole *F reading corrects both through the 2x2 Kalman
+ *  gain. getRate() is b + u. getPredicted() carries T from the last
+ *  reading to now and then getLead() further, with the outputs
+ *  running now, so it holds between readings that come minutes apart.
+ *  Once no reading came for KF_STALE_LEADS look aheads isStale() is
+ *  true and hvacLogic goes back to the last raw reading.
+ *
+ *  All fixed point for the MCU, no float: T in 1/65536 *F, rates
+ *  in 1/65536 *F per hour, covariance in 1/65536 of its units, 64
+ *  bit products. The same few operations every update.
+ *
+ */
+
+
+#ifndef TEMPESTIMATOR_H
+#define TEMPESTIMATOR_H
+
+#pragma once
+
+#include "hvac.h"
+
+//fixed point one
+#define KF_ONE 65536L
+//sensor variance, whole *F readings plus noise, 1/65536 *F^2 (16384, 0.25)
+#define KF_SENSOR 16384L
+//temperature process noise, 1/65536 *F^2 per hour (32768, 0.5)
+#define KF_NOISE_TEMP 32768L
+//drift process noise, 1/65536 (*F/h)^2 per hour (262144, 4)
+#define KF_NOISE_RATE 262144L
+//drift variance at the first reading, 1/65536 (*F/h)^2 (6553600, 100)
+#define KF_START_RATE 6553600L
+//longest step predicted in one go, ms (3600000)
+#define KF_MAX_STEP 3600000UL
+//look ahead of getPredicted() ms (300000)
+#define KF_LEAD 300000UL
+//look aheads without a reading after which the estimate is stale, see isStale() (3)
+#define KF_STALE_LEADS 3
+
+/// @brief Temperature and drift estimate from readings and output rates
+class tempEstimator
+{
+public:
+    tempEstimator();
+    void reset();
+    void update(int temp, long inputRate, unsigned long now);
+    /// @brief A reading has been taken
+    bool isValid() {return e_valid;};
+    /// @brief Filtered temperature
+    /// @return 1/65536 *F
+    long getTemp() {return e_temp;};
+    /// @brief Filtered temperature rounded
+    /// @return *F
+    int getTempF() {return e_round(e_temp);};
+    /// @brief Rate the cabin moves at, drift plus outputs
+    /// @return 1/100 *F per hour
+    long getRate() {return (long)(((long long)(e_drift + e_input) * 100) / KF_ONE);};
+    /// @brief Drift alone, what the cabin does with nothing running
+    /// @return 1/100 *F per hour
+    long getDrift() {return (long)(((long long)e_drift * 100) / KF_ONE);};
+    int getPredicted(unsigned long now, long inputRate);
+    /// @brief Sets how far ahead getPredicted() looks
+    /// @param lead ms
+    void setLead(unsigned long lead) {e_lead = lead;};
+    unsigned long getLead() {return e_lead;};
+    /// @brief No reading for KF_STALE_LEADS look aheads, ie: the sensor stopped, do not extrapolate on
+    /// @param now ms, ie: timeNow()
+    bool isStale(unsigned long now) {return !e_valid || (now - e_time) > (unsigned long)KF_STALE_LEADS * e_lead;};
+
+private:
+    static int e_round(long q) {return (int)((q >= 0 ? q + KF_ONE / 2 : q - KF_ONE / 2) / KF_ONE);};
+    bool e_valid;
+    unsigned long e_time; //timeNow() of the last update
+    unsigned long e_lead;
+    long e_temp; //T, 1/65536 *F
+    long e_drift; //b, 1/65536 *F per hour
+    long e_input; //u at the last update, 1/65536 *F per hour
+    long e_p00; //covariance, 1/65536 *F^2
+    long e_p01; //1/65536 *F^2 per hour
+    long e_p11; //1/65536 (*F/h)^2
+};
+
+#endif
@@ -0,0 +1,192 @@
+/** @file thermalFit.cpp
+ *  @brief Fits cabin model parameters from recorded telemetry.
+ *
+ */
+
+
+
+#include "thermalFit.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+//unknowns: UA/C then Q/C of each fitSource
+#define FIT_N (1 + FS_SizeOf)
+//keeps unobserved sources at zero instead of singular
+#define FIT_RIDGE 1e-6
+
+static const float fitDefaults[FS_SizeOf] = {CAP_COMP, CAP_HEATPUMP, CAP_GAS, CAP_COACH_LOW, CAP_COACH_HIGH};
+
+/// @brief Seconds since Jan 1 of the year of unix time t, to index TMY weather
+static unsigned long fitYearSecond(unsigned long t) {
+    unsigned long days = t / 86400UL;
+    unsigned long year = 1970;
+    for (;;) {
+        unsigned long length = ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0) ? 366 : 365;
+        if (days < length) break;
+        days -= length;
+        year++;
+    }
+    return days * 86400UL + t % 86400UL;
+}
+
+/// @brief Regression row of one output bitmask, running units of each source
+static void fitRow(unsigned int mask, double *x) {
+    int comps = ((mask >> HI_Comp1) & 1) + ((mask >> HI_Comp2) & 1);
+    bool reverse = (mask & (1u << HI_reversingValve)) != 0;
+    x[1 + FS_Cool] = reverse ? 0 : -comps; //cooling removes heat
+    x[1 + FS_HeatPump] = reverse ? comps : 0;
+    x[1 + FS_Gas] = (mask & (1u << HI_gasHeat)) ? 1 : 0;
+    x[1 + FS_CoachLow] = (mask & (1u << HI_CoachHeatLow)) ? 1 : 0;
+    x[1 + FS_CoachHigh] = (mask & (1u << HI_CoachHeatHigh)) ? 1 : 0;
+    return;
+}
+
+/// @brief Solves the symmetric positive system a x = b in place (Cholesky)
+static bool fitSolve(double a[FIT_N][FIT_N], double *b, double *x) {
+    for (int j = 0; j < FIT_N; j++) {
+        double d = a[j][j];
+        for (int k = 0; k < j; k++) d -= a[j][k] * a[j][k];
+        if (d <= 0) return false;
+        a[j][j] = sqrt(d);
+        for (int i = j + 1; i < FIT_N; i++) {
+            double s = a[i][j];
+            for (int k = 0; k < j; k++) s -= a[i][k] * a[j][k];
+            a[i][j] = s / a[j][j];
+        }
+    }
+    for (int i = 0; i < FIT_N; i++) {
+        double s = b[i];
+        for (int k = 0; k < i; k++) s -= a[i][k] * x[k];
+        x[i] = s / a[i][i];
+    }
+    for (int i = FIT_N - 1; i >= 0; i--) {
+        double s = x[i];
+        for (int k = i + 1; k < FIT_N; k++) s -= a[k][i] * x[k];
+        x[i] = s / a[i][i];
+    }
+    return true;
+}
+
+/// @brief Fits one coach from its telemetry
+/// @param cols telemetry, rows in time order
+/// @param weather outdoor temperature source or NULL
+/// @param outdoor *F used when weather is NULL
+/// @param fit receives the parameters
+/// @return true if UA and mass were fitted
+bool fitCoach(const telemetryColumns &cols, const weatherData *weather, float outdoor, cabinFit &fit) {
+    double ata[FIT_N][FIT_N] = {};
+    double atb[FIT_N] = {};
+    double yy = 0;
+    unsigned long on[FS_SizeOf] = {};
+    double x[FIT_N];
+    fit.ok = false;
+    fit.samples = 0;
+    fit.rms = 0;
+    fit.ua = 0;
+    fit.mass = FIT_DEFAULT_MASS;
+    for (int s = 0; s < FS_SizeOf; s++) {
+        fit.capacity[s] = fitDefaults[s];
+        fit.fitted[s] = false;
+    }
+
+    //one pass, slope of each sample pair against the outputs of the first
+    for (size_t i = 0; i + 1 < cols.size(); i++) {
+        unsigned long gap = cols.time[i + 1] - cols.time[i];
+        if (cols.time[i + 1] <= cols.time[i] || gap > FIT_MAX_GAP) continue;
+        double hours = gap / 3600.0;
+        double y = (cols.temp[i + 1] - cols.temp[i]) / hours;
+        double mid = (cols.temp[i + 1] + cols.temp[i]) * 0.5;
+        double out = weather ? weather->at(fitYearSecond(cols.time[i])).temp : outdoor;
+        x[0] = out - mid;
+        fitRow(cols.outputs[i], x);
+        for (int r = 0; r < FIT_N; r++) {
+            for (int c = 0; c <= r; c++) ata[r][c] += x[r] * x[c];
+            atb[r] += x[r] * y;
+        }
+        for (int s = 0; s < FS_SizeOf; s++) if (x[1 + s] != 0) on[s]++;
+        yy += y * y;
+        fit.samples++;
+    }
+    if (fit.samples < FIT_N) return false;
+
+    double a[FIT_N][FIT_N];
+    double b[FIT_N];
+    double beta[FIT_N];
+    for (int r = 0; r < FIT_N; r++) {
+        for (int c = 0; c <= r; c++) a[r][c] = a[c][r] = ata[r][c];
+        a[r][r] += FIT_RIDGE * (1.0 + ata[r][r]);
+        b[r] = atb[r];
+    }
+    if (!fitSolve(a, b, beta) || beta[0] <= 0) return false;
+
+    //residual from normal equations: y'y - 2 beta'A'y + beta'A'A beta
+    double sse = yy;
+    for (int r = 0; r < FIT_N; r++) {
+        sse -= 2 * beta[r] * atb[r];
+        for (int c = 0; c < FIT_N; c++) sse += beta[r] * beta[c] * (r >= c ? ata[r][c] : ata[c][r]);
+    }
+    fit.rms = (float)sqrt(sse > 0 ? sse / fit.samples : 0);
+
+    //scale from the furnace rating when it ran
+    if (on[FS_Gas] >= FIT_MIN_ON && beta[1 + FS_Gas] > 0) fit.mass = (float)(CAP_GAS / beta[1 + FS_Gas]);
+    fit.ua = (float)(beta[0] * fit.mass);
+    for (int s = 0; s < FS_SizeOf; s++) {
+        if (on[s] >= FIT_MIN_ON && beta[1 + s] > 0) {
+            fit.capacity[s] = (float)(beta[1 + s] * fit.mass);
+            fit.fitted[s] = true;
+        }
+    }
+    fit.ok = true;
+    return true;
+}
+
+/// @brief Heat input of each output bitmask with a coach's fitted capacities,
+/// same layout as cabinMaskHeat, sources as in the fit so fan heat is left out
+/// @param fit from fitCoach(), capacities not fitted are the CAP_ defaults
+/// @param table receives CABIN_MASKS entries BTU/h
+void fitMaskHeat(const cabinFit &fit, float *table) {
+    double x[FIT_N];
+    for (unsigned int m = 0; m < CABIN_MASKS; m++) {
+        fitRow(m, x);
+        double heat = 0;
+        for (int s = 0; s < FS_SizeOf; s++) heat += x[1 + s] * fit.capacity[s];
+        table[m] = (float)heat;
+    }
+    return;
+}
+
+/// @brief Fits many coaches in parallel, one telemetry file each
+/// @param telemetryPaths files written by logIngest()
+/// @param weather outdoor temperature source or NULL, shared read only
+/// @param outdoor *F used when weather is NULL
+/// @param fits receives one fit per path, in path order
+/// @param threads worker threads, 0 for hardware concurrency
+/// @return number of coaches fitted
+int fitCoaches(const std::vector<std::string> &telemetryPaths, const weatherData *weather, float outdoor,
+               std::vector<cabinFit> &fits, int threads) {
+    fits.resize(telemetryPaths.size());
+    if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+    if (threads > (int)telemetryPaths.size()) threads = (int)telemetryPaths.size();
+    std::atomic<size_t> next(0);
+    std::atomic<int> done(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&]() {
+            telemetryColumns cols;
+            for (size_t i = next++; i < telemetryPaths.size(); i = next++) {
+                fits[i].ok = false;
+                if (logReadColumns(telemetryPaths[i], cols) && fitCoach(cols, weather, outdoor, fits[i])) done++;
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    debugI("fitCoaches fitted: ");
+    debuglnI(done.load());
+    return done.load();
+}
+#endif
@@ -0,0 +1,53 @@
+/** @file thermalFit.h
+ *  @brief Fits cabin model parameters from recorded telemetry.
+ *
+ *  Uses the cabinModel equation C dT/dt = UA (Tout - T) + Q,
+ *  with Q the sum of the capacities of running sources from the
+ *  output bitmask. Divided by C it is linear in UA/C and each
+ *  Q/C, so one pass builds least squares normal equations per
+ *  coach. The gas furnace rating (CAP_GAS) sets the scale of C.
+ *
+ */
+
+
+#ifndef THERMALFIT_H
+#define THERMALFIT_H
+
+#pragma once
+
+#include "cabinModel.h"
+#include "logIngest.h"
+#include "weather.h"
+
+#ifdef WIN32
+#include <string>
+#include <vector>
+
+//longest gap between samples used for a slope in seconds (900)
+#define FIT_MAX_GAP 900
+//thermal mass used when gas heat never ran, BTU per *F (4500)
+#define FIT_DEFAULT_MASS 4500.0f
+//least samples a source must run to fit its capacity (30)
+#define FIT_MIN_ON 30
+
+/// @brief Fitted sources, columns of the regression after UA/C
+enum fitSource {FS_Cool, FS_HeatPump, FS_Gas, FS_CoachLow, FS_CoachHigh, FS_SizeOf};
+
+/// @brief Fitted parameters of one coach, units as cabinModel.h
+struct cabinFit {
+    bool ok; //enough data to fit UA
+    float ua; //BTU/h per *F
+    float mass; //BTU per *F
+    float capacity[FS_SizeOf]; //BTU/h each compressor or source, CAP_ default if not fitted
+    bool fitted[FS_SizeOf]; //capacity came from data
+    unsigned long samples; //slopes used
+    float rms; //residual *F per hour
+};
+
+bool fitCoach(const telemetryColumns &cols, const weatherData *weather, float outdoor, cabinFit &fit);
+void fitMaskHeat(const cabinFit &fit, float *table);
+int fitCoaches(const std::vector<std::string> &telemetryPaths, const weatherData *weather, float outdoor,
+               std::vector<cabinFit> &fits, int threads);
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Code and RAM size of hvac.cpp for each coach variant (see COACH VARIANTS in README.md).
+#
+# usage: ./variantSize.sh [compiler flags...]
+#   CXX and SIZE pick the toolchain, ie: for the MCU
+#   CXX=arm-none-eabi-g++ SIZE=arm-none-eabi-size ./variantSize.sh -mcpu=cortex-m4 -mthumb -I<StateMachine dir>
+#
+# Prints text, data and bss of the hvac.cpp object per variant and the
+# text saved against the full build, run it before and after a change.
+
+CXX=${CXX:-g++}
+SIZE=${SIZE:-size}
+DIR=$(cd "$(dirname "$0")" && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+#hvac.h needs StateMachine.h (not in this repo), say so rather than fail on the first variant
+if ! echo '#include "StateMachine.h"' | $CXX -std=c++17 -E -x c++ - -I"$DIR" "$@" -o /dev/null 2>/dev/null; then
+    echo "variantSize.sh: StateMachine.h not found, pass its directory: ./variantSize.sh -I<StateMachine dir>" >&2
+    exit 1
+fi
+
+full=""
+printf '%-14s %8s %6s %6s %8s\n' variant text data bss saved
+while read -r name flags; do
+    if ! $CXX -std=c++17 -Os -c "$DIR/hvac.cpp" -I"$DIR" "$@" $flags -o "$OUT/$name.o"; then
+        echo "$name: compile failed" >&2
+        exit 1
+    fi
+    line=$($SIZE "$OUT/$name.o" | tail -n 1)
+    text=$(echo "$line" | awk '{print $1}')
+    data=$(echo "$line" | awk '{print $2}')
+    bss=$(echo "$line" | awk '{print $3}')
+    [ -z "$full" ] && full=$text
+    printf '%-14s %8s %6s %6s %8s\n' "$name" "$text" "$data" "$bss" "$((full - text))"
+done <<EOF
+full
+noHeatPump -DHVAC_HAS_HEAT_PUMP=0
+noCoachHeat -DHVAC_HAS_COACH_HEAT=0
+noComp2 -DHVAC_HAS_COMP2=0
+minimal -DHVAC_HAS_HEAT_PUMP=0 -DHVAC_HAS_COACH_HEAT=0 -DHVAC_HAS_COMP2=0
+EOF
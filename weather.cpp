@@ -0,0 +1,165 @@
+/** @file weather.cpp
+ *  @brief Shared weather time series for simulation.
+ *
+ */
+
+
+
+#include "weather.h"
+#include "JAHdebug.h"
+
+#ifdef WIN32
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdlib>
+
+//TMY3 column names
+static const char *weatherTempColumn = "Dry-bulb (C)";
+static const char *weatherSolarColumn = "GHI (W/m^2)";
+static const char *weatherHumidityColumn = "RHum (%)";
+
+/// @brief Splits one CSV line on commas
+static void weatherSplit(const std::string &line, std::vector<std::string> &fields) {
+    fields.clear();
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) fields.push_back(field);
+    return;
+}
+
+/// @brief Converts TMY style CSV to the binary weather format
+/// @param csvPath hourly CSV with a header row naming the TMY3 columns
+/// @param binPath binary file to write
+/// @return true if succesful
+bool weatherConvert(const std::string &csvPath, const std::string &binPath) {
+    std::ifstream in(csvPath.c_str());
+    if (!in) return false;
+    std::string line;
+    std::vector<std::string> fields;
+    int tempCol = -1;
+    int solarCol = -1;
+    int humidityCol = -1;
+    //find header row, TMY3 has a site line before it
+    while (tempCol < 0 && std::getline(in, line)) {
+        weatherSplit(line, fields);
+        for (int i = 0; i < (int)fields.size(); i++) {
+            if (fields[i] == weatherTempColumn) tempCol = i;
+            if (fields[i] == weatherSolarColumn) solarCol = i;
+            if (fields[i] == weatherHumidityColumn) humidityCol = i;
+        }
+    }
+    if (tempCol < 0 || solarCol < 0 || humidityCol < 0) {
+        debuglnI("weatherConvert: missing column");
+        return false;
+    }
+    std::vector<weatherRecord> records;
+    while (std::getline(in, line)) {
+        weatherSplit(line, fields);
+        if ((int)fields.size() <= tempCol || (int)fields.size() <= solarCol || (int)fields.size() <= humidityCol) continue;
+        double tenths = (atof(fields[tempCol].c_str()) * 9.0 / 5.0 + 32.0) * 10.0;
+        weatherRecord r;
+        r.temp = (short)(tenths < 0 ? tenths - 0.5 : tenths + 0.5);
+        r.solar = (short)atoi(fields[solarCol].c_str());
+        r.humidity = (short)(atof(fields[humidityCol].c_str()) * 10.0 + 0.5);
+        records.push_back(r);
+    }
+    if (records.empty()) return false;
+
+    weatherHeader h;
+    h.magic = WEATHER_MAGIC;
+    h.version = WEATHER_VERSION;
+    h.count = (unsigned long)records.size();
+    h.step = WEATHER_STEP;
+    std::ofstream out(binPath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)&records[0], records.size() * sizeof(weatherRecord));
+    debugI("weatherConvert records: ");
+    debuglnI(h.count);
+    return out.good();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+
+weatherData::weatherData() :
+    w_file(INVALID_HANDLE_VALUE),
+    w_map(NULL),
+    w_view(NULL),
+    w_records(NULL),
+    w_count(0),
+    w_step(WEATHER_STEP)
+{
+}
+
+weatherData::~weatherData() {
+    close();
+}
+
+/// @brief Maps a converted weather file read only
+/// @param binPath file written by weatherConvert()
+/// @return true if mapped and valid
+bool weatherData::open(const std::string &binPath) {
+    close();
+    w_file = CreateFileA(binPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (w_file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(w_file, &size) || size.QuadPart < (LONGLONG)sizeof(weatherHeader)) {
+        close();
+        return false;
+    }
+    w_map = CreateFileMappingA(w_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (w_map == NULL) {
+        close();
+        return false;
+    }
+    w_view = MapViewOfFile(w_map, FILE_MAP_READ, 0, 0, 0);
+    if (w_view == NULL) {
+        close();
+        return false;
+    }
+    const weatherHeader *h = (const weatherHeader *)w_view;
+    if (h->magic != WEATHER_MAGIC || h->version != WEATHER_VERSION || h->count == 0 || h->step == 0 ||
+        (LONGLONG)(sizeof(weatherHeader) + h->count * sizeof(weatherRecord)) > size.QuadPart) {
+        debuglnI("weatherData: bad file");
+        close();
+        return false;
+    }
+    w_count = h->count;
+    w_step = h->step;
+    w_records = (const weatherRecord *)(h + 1);
+    w_path = binPath;
+    return true;
+}
+
+void weatherData::close() {
+    if (w_view != NULL) UnmapViewOfFile(w_view);
+    if (w_map != NULL) CloseHandle(w_map);
+    if (w_file != INVALID_HANDLE_VALUE) CloseHandle(w_file);
+    w_file = INVALID_HANDLE_VALUE;
+    w_map = NULL;
+    w_view = NULL;
+    w_records = NULL;
+    w_count = 0;
+    w_path.clear();
+    return;
+}
+
+/// @brief Weather at a time, linear between records, wraps at end of series
+/// @param seconds seconds from start of series (start of year for TMY)
+/// @return interpolated sample, zero if not open
+weatherSample weatherData::at(unsigned long seconds) const {
+    weatherSample s = {0, 0, 0};
+    if (w_records == NULL) return s;
+    unsigned long i = (seconds / w_step) % w_count;
+    unsigned long next = (i + 1) % w_count;
+    float frac = (float)(seconds % w_step) / (float)w_step;
+    const weatherRecord &a = w_records[i];
+    const weatherRecord &b = w_records[next];
+    s.temp = (a.temp + (b.temp - a.temp) * frac) * 0.1f;
+    s.solar = a.solar + (b.solar - a.solar) * frac;
+    s.humidity = (a.humidity + (b.humidity - a.humidity) * frac) * 0.1f;
+    return s;
+}
+#endif
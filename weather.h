@@ -0,0 +1,79 @@
+/** @file weather.h
+ *  @brief Shared weather time series for simulation.
+ *
+ *  Typical meteorological year (TMY) CSV is converted once to a
+ *  small binary file. Simulator threads then share one read-only
+ *  memory mapped copy of it through a weatherData instance.
+ *
+ */
+
+
+#ifndef WEATHER_H
+#define WEATHER_H
+
+#pragma once
+
+#ifdef WIN32
+#include <windows.h>
+#include <string>
+#endif
+
+//binary file magic "WTHR"
+#define WEATHER_MAGIC 0x52485457
+#define WEATHER_VERSION 1
+//TMY files are one record per hour
+#define WEATHER_STEP 3600
+
+/// @brief Binary file header, followed by count weatherRecord
+struct weatherHeader {
+    unsigned long magic; //WEATHER_MAGIC
+    unsigned long version; //WEATHER_VERSION
+    unsigned long count; //number of records
+    unsigned long step; //seconds between records
+};
+
+/// @brief One stored sample, fixed point to keep file small
+struct weatherRecord {
+    short temp; //outdoor temperature 0.1 *F
+    short solar; //global horizontal irradiance W/m^2
+    short humidity; //relative humidity 0.1 %
+};
+
+/// @brief Interpolated weather at a time
+struct weatherSample {
+    float temp; //*F
+    float solar; //W/m^2
+    float humidity; //%
+};
+
+#ifdef WIN32
+bool weatherConvert(const std::string &csvPath, const std::string &binPath);
+
+/// @brief Read only weather series, safe to share between threads after open()
+class weatherData
+{
+public:
+    weatherData();
+    ~weatherData();
+    bool open(const std::string &binPath);
+    void close();
+    bool isOpen() const {return w_records != 0;};
+    unsigned long getCount() const {return w_count;};
+    /// @brief File given to open(), to open the same series in another process
+    const std::string &getPath() const {return w_path;};
+    weatherSample at(unsigned long seconds) const;
+
+private:
+    weatherData(const weatherData &);
+    weatherData &operator=(const weatherData &);
+    HANDLE w_file;
+    HANDLE w_map;
+    const void *w_view;
+    const weatherRecord *w_records; //start of records inside w_view
+    unsigned long w_count;
+    unsigned long w_step;
+    std::string w_path;
+};
+#endif
+
+#endif